@@ -0,0 +1,814 @@
+#pragma once
+
+// 查询测试工具共用的 HealPix 辅助函数
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_set>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <map>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <taos.h>
+
+#include <healpix_cxx/healpix_base.h>
+#include <healpix_cxx/pointing.h>
+#include <healpix_cxx/rangeset.h>
+#include <healpix_cxx/vec3.h>
+#include <healpix_cxx/arr.h>
+
+// 由 query_disc 的 rangeset 结果生成像素过滤条件。
+// NEST 编号下圆盘内的像素通常只形成少数几段连续区间：长度不小于 range_threshold 的区间写成
+// BETWEEN（两个字面量加一个 OR 分支），较短的区间展开进同一个 IN 列表，
+// 使 SQL 长度和服务端谓词计算量都随区间数而不是像素数增长。
+template <typename I>
+inline std::string buildPixelPredicate(const rangeset<I>& pixels,
+                                       const std::string& column = "healpix_id",
+                                       I range_threshold = 4) {
+    std::ostringstream in_list;
+    std::ostringstream between;
+    size_t in_count = 0;
+    size_t between_count = 0;
+
+    for (size_t r = 0; r < pixels.nranges(); ++r) {
+        I begin = pixels.ivbegin(r);
+        I end = pixels.ivend(r);  // 半开区间 [begin, end)
+        if (end - begin >= range_threshold) {
+            if (between_count++ > 0) between << " OR ";
+            between << column << " BETWEEN " << begin << " AND " << (end - 1);
+        } else {
+            for (I pix = begin; pix < end; ++pix) {
+                if (in_count++ > 0) in_list << ",";
+                in_list << pix;
+            }
+        }
+    }
+
+    if (in_count == 0 && between_count == 0) {
+        return "1 = 0";
+    }
+
+    std::string predicate;
+    if (in_count > 0) {
+        predicate = column + (in_count == 1 ? " = " + in_list.str() : " IN (" + in_list.str() + ")");
+    }
+    if (between_count > 0) {
+        if (!predicate.empty()) predicate += " OR ";
+        predicate += between.str();
+    }
+    // 多个分支时加括号，便于与其他条件用 AND 组合
+    return (between_count + (in_count > 0 ? 1 : 0) > 1) ? "(" + predicate + ")" : predicate;
+}
+
+// 导入器的多分辨率分区：基础区块记录数超过阈值时细分到 nside_fine，
+// 子表标签为 (base_id << 32) + fine_id，其余区块标签即 base_id。
+// 分区决策由导入器写在 output/query_results/healpix_partition_map.csv，查询端据此生成同编码的像素条件。
+class HealpixPartition {
+public:
+    typedef std::pair<int64_t, int64_t> TagRange;  // 半开区间 [first, second)
+
+    explicit HealpixPartition(int nside_base = 64, int nside_fine = 256) {
+        setResolution(nside_base, nside_fine);
+    }
+
+    // 读取分区表并采用其中的分辨率；文件不存在时保持全部区块未细分
+    bool load(const std::string& path, std::string& error) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            error = "未找到分区表 " + path;
+            return false;
+        }
+        std::string line;
+        std::getline(file, line);
+        int file_base = 0, file_fine = 0, file_threshold = 0;
+        if (std::sscanf(line.c_str(), "# nside_base=%d nside_fine=%d count_threshold=%d",
+                        &file_base, &file_fine, &file_threshold) != 3) {
+            error = "分区表格式无效: " + path;
+            return false;
+        }
+        setResolution(file_base, file_fine);
+        std::getline(file, line);  // 列名
+        while (std::getline(file, line)) {
+            long base_id = 0, count = 0;
+            int refined = 0;
+            if (std::sscanf(line.c_str(), "%ld,%ld,%d", &base_id, &count, &refined) == 3 && refined) {
+                refined_.insert(base_id);
+            }
+        }
+        return true;
+    }
+
+    int nsideBase() const { return nside_base_; }
+    int nsideFine() const { return nside_fine_; }
+    size_t refinedCount() const { return refined_.size(); }
+    bool isRefined(long base_id) const { return refined_.count(base_id) > 0; }
+    const Healpix_Base& base() const { return *base_; }
+    const Healpix_Base& fine() const { return *fine_; }
+
+    // 与导入器 calculateAdaptiveHealpixId 相同的编码
+    int64_t tagOf(const pointing& pt) const {
+        long base_id = base_->ang2pix(pt);
+        if (!isRefined(base_id)) return base_id;
+        return (static_cast<int64_t>(base_id) << 32) + fine_->ang2pix(pt);
+    }
+
+    // 整个基础区块对应的标签区间：细分区块为其全部细分像素
+    TagRange baseRange(long base_id) const {
+        if (!isRefined(base_id)) return {base_id, base_id + 1};
+        int64_t prefix = static_cast<int64_t>(base_id) << 32;
+        return {prefix + base_id * ratio_, prefix + (base_id + 1) * ratio_};
+    }
+
+    // 覆盖若干完整基础区块的像素条件
+    std::string basePredicate(const std::vector<long>& base_ids, const std::string& column = "healpix_id") const {
+        std::vector<TagRange> ranges;
+        for (long base_id : base_ids) ranges.push_back(baseRange(base_id));
+        return predicateOf(ranges, column);
+    }
+
+    // 锥形区域的像素条件：未细分区块按基础分辨率覆盖，细分区块内只取与圆盘相交的细分像素。
+    // 两级都用 query_disc_inclusive，保证与圆盘相交的像素都被覆盖，精确距离由调用方过滤
+    std::string conePredicate(const pointing& center, double radius_rad,
+                              const std::string& column = "healpix_id") const {
+        std::vector<TagRange> ranges = coneRanges(center, radius_rad);
+        return predicateOf(ranges, column);
+    }
+
+    // 锥形区域覆盖的标签区间（未排序合并）
+    std::vector<TagRange> coneRanges(const pointing& center, double radius_rad) const {
+        std::vector<TagRange> ranges;
+        rangeset<int> bases;
+        base_->query_disc_inclusive(center, radius_rad, bases);
+        bool touches_refined = false;
+        for (size_t r = 0; r < bases.nranges(); ++r) {
+            for (int b = bases.ivbegin(r); b < bases.ivend(r); ++b) {
+                if (isRefined(b)) {
+                    touches_refined = true;
+                } else {
+                    ranges.push_back({b, b + 1});
+                }
+            }
+        }
+        if (touches_refined) {
+            rangeset<int> fines;
+            fine_->query_disc_inclusive(center, radius_rad, fines);
+            for (size_t r = 0; r < fines.nranges(); ++r) {
+                int64_t begin = fines.ivbegin(r);
+                int64_t end = fines.ivend(r);
+                // NEST 下基础区块 b 的细分像素为 [b*ratio, (b+1)*ratio)，按区块边界切开
+                while (begin < end) {
+                    long b = static_cast<long>(begin / ratio_);
+                    int64_t stop = std::min<int64_t>(end, (b + 1) * ratio_);
+                    if (isRefined(b)) {
+                        int64_t prefix = static_cast<int64_t>(b) << 32;
+                        ranges.push_back({prefix + begin, prefix + stop});
+                    }
+                    begin = stop;
+                }
+            }
+        }
+        if (ranges.empty()) {
+            ranges.push_back(baseRange(base_->ang2pix(center)));
+        }
+        return ranges;
+    }
+
+    // 任意标签区间集合的像素条件：排序合并后交给 buildPixelPredicate
+    static std::string predicateOf(std::vector<TagRange>& ranges, const std::string& column = "healpix_id") {
+        if (ranges.empty()) return "1 = 0";
+        std::sort(ranges.begin(), ranges.end());
+        rangeset<int64_t> merged;
+        int64_t begin = ranges[0].first;
+        int64_t end = ranges[0].second;
+        for (size_t i = 1; i < ranges.size(); ++i) {
+            if (ranges[i].first <= end) {
+                end = std::max(end, ranges[i].second);
+            } else {
+                merged.append(begin, end);
+                begin = ranges[i].first;
+                end = ranges[i].second;
+            }
+        }
+        merged.append(begin, end);
+        return buildPixelPredicate(merged, column);
+    }
+
+private:
+    int nside_base_ = 0;
+    int nside_fine_ = 0;
+    int64_t ratio_ = 1;  // 每个基础区块包含的细分像素数
+    std::unique_ptr<Healpix_Base> base_;
+    std::unique_ptr<Healpix_Base> fine_;
+    std::unordered_set<long> refined_;
+
+    void setResolution(int nside_base, int nside_fine) {
+        nside_base_ = nside_base;
+        nside_fine_ = nside_fine;
+        int64_t scale = nside_fine / nside_base;
+        ratio_ = scale * scale;
+        base_ = std::make_unique<Healpix_Base>(nside_base, NEST, SET_NSIDE);
+        fine_ = std::make_unique<Healpix_Base>(nside_fine, NEST, SET_NSIDE);
+    }
+};
+
+// 同时求 sin/cos：按 π/2 做三段 Cody-Waite 约简到 [-π/4, π/4]，再用 Cephes 的极小极大多项式，
+// 按象限交换与取负。只有乘加、取整和选择，不调用 libm（libm 调用受 errno 语义约束，编译器不会向量化），
+// |x| 不超过几千弧度时误差在 1 ulp 量级。
+inline void fastSinCos(double x, double& sin_out, double& cos_out) {
+    const double kTwoOverPi = 0.63661977236758134308;
+    const double kRound = 6755399441055744.0;  // 1.5 * 2^52，加减一次即舍入到整数
+    double q = (x * kTwoOverPi + kRound) - kRound;
+    double r = ((x - q * 1.57079632673412561417e+00) - q * 6.07710050630396597660e-11) - q * 2.02226624879595063154e-21;
+    double z = r * r;
+    double s = r + r * z * (((((1.58962301576546568060e-10 * z - 2.50507477628578072866e-8) * z +
+                                2.75573136213857245213e-6) * z - 1.98412698295895385996e-4) * z +
+                              8.33333333332211858878e-3) * z - 1.66666666666666307295e-1);
+    double c = 1.0 - 0.5 * z + z * z * (((((-1.13585365213876817300e-11 * z + 2.08757008419747316778e-9) * z -
+                                           2.75573141792967388112e-7) * z + 2.48015872888517045348e-5) * z -
+                                         1.38888888888730564116e-3) * z + 4.16666666666665929218e-2);
+    // 象限 q mod 4 用 m = q - 4·round(q/4) ∈ {-2..2} 表示，全程留在浮点，避免 double→int64 转换阻碍向量化
+    double m = q - 4.0 * ((q * 0.25 + kRound) - kRound);
+    double am = std::fabs(m);
+    bool swap = am == 1.0;
+    double swapped_sin = swap ? c : s;
+    double swapped_cos = swap ? s : c;
+    sin_out = (am == 2.0 || m == -1.0) ? -swapped_sin : swapped_sin;
+    cos_out = (am == 2.0 || m == 1.0) ? -swapped_cos : swapped_cos;
+}
+
+// 批量角距离筛选：坐标转为单位向量后与锥心单位向量做点积，和 cos(半径) 比较，逐行不再调用 acos。
+// 输入为分离存储的 ra/dec 列（度）；三角函数用上面的多项式 fastSinCos，循环体只有算术与选择，
+// Release 构建（-O3）下 GCC 可直接向量化，不依赖 -ffast-math。
+class ConeFilter {
+public:
+    ConeFilter(double ra_deg, double dec_deg, double radius_deg)
+        : cos_radius_(std::cos(radius_deg * kDeg2Rad)) {
+        double ra = ra_deg * kDeg2Rad;
+        double dec = dec_deg * kDeg2Rad;
+        cx_ = std::cos(dec) * std::cos(ra);
+        cy_ = std::cos(dec) * std::sin(ra);
+        cz_ = std::sin(dec);
+    }
+
+    // 每行与锥心的点积（夹角余弦）
+    void dots(const double* ra, const double* dec, size_t n, double* out) const {
+        const double cx = cx_, cy = cy_, cz = cz_;
+        for (size_t i = 0; i < n; ++i) {
+            double sin_a, cos_a, sin_d, cos_d;
+            fastSinCos(ra[i] * kDeg2Rad, sin_a, cos_a);
+            fastSinCos(dec[i] * kDeg2Rad, sin_d, cos_d);
+            out[i] = cos_d * cos_a * cx + cos_d * sin_a * cy + sin_d * cz;
+        }
+    }
+
+    // 选择掩码：锥内为 1，返回命中数
+    size_t mask(const double* ra, const double* dec, size_t n, std::vector<uint8_t>& out) const {
+        dot_.resize(n);
+        out.resize(n);
+        dots(ra, dec, n, dot_.data());
+        size_t hits = 0;
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = dot_[i] > cos_radius_;
+            hits += out[i];
+        }
+        return hits;
+    }
+
+    // 锥内行的下标
+    size_t select(const double* ra, const double* dec, size_t n, std::vector<uint32_t>& indices) const {
+        dot_.resize(n);
+        dots(ra, dec, n, dot_.data());
+        indices.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (dot_[i] > cos_radius_) indices.push_back(static_cast<uint32_t>(i));
+        }
+        return indices.size();
+    }
+
+    // 最大点积即最近距离；n 为 0 时返回 -2
+    double maxDot(const double* ra, const double* dec, size_t n) const {
+        dot_.resize(n);
+        dots(ra, dec, n, dot_.data());
+        double best = -2.0;
+        for (size_t i = 0; i < n; ++i) best = std::max(best, dot_[i]);
+        return best;
+    }
+
+    static double dotToDegrees(double dot) {
+        return std::acos(std::max(-1.0, std::min(1.0, dot))) / kDeg2Rad;
+    }
+
+private:
+    static constexpr double kDeg2Rad = 3.14159265358979323846 / 180.0;
+    double cos_radius_;
+    double cx_, cy_, cz_;
+    mutable std::vector<double> dot_;  // 复用的点积缓冲
+};
+
+// 按块读取查询结果：taos_fetch_block 每次返回一块，定长列（DOUBLE/TIMESTAMP/BIGINT 等）在块内连续存放，
+// 直接以类型化数组交给向量化筛选和结果汇总，不再逐行调用 taos_fetch_row 和解引用 row[i]。
+// 导入器写入的 ra/dec/mag/ts 不含 NULL；含 NULL 的列可用 compact() 剔除后再使用。
+class BlockResultReader {
+public:
+    explicit BlockResultReader(TAOS_RES* res) : res_(res) {
+        num_fields_ = taos_num_fields(res);
+        fields_ = taos_fetch_fields(res);
+    }
+
+    // 按列名查找列下标，不存在或类型不符时返回 -1
+    int column(const char* name, int type) const {
+        for (int c = 0; c < num_fields_; ++c) {
+            if (std::strcmp(fields_[c].name, name) == 0) {
+                return fields_[c].type == type ? c : -1;
+            }
+        }
+        return -1;
+    }
+
+    int columnType(int c) const { return fields_[c].type; }
+
+    // 同步读取下一块，返回行数；0 表示结束
+    int next() {
+        rows_ = taos_fetch_block(res_, &cols_);
+        if (rows_ <= 0) {
+            rows_ = 0;
+            cols_ = nullptr;
+        }
+        return rows_;
+    }
+
+    // 异步回调中绑定 taos_fetch_rows_a 刚取到的块
+    void bind(int rows) {
+        TAOS_ROW* block = taos_result_block(res_);
+        cols_ = block ? *block : nullptr;
+        rows_ = cols_ ? rows : 0;
+    }
+
+    int rows() const { return rows_; }
+
+    template <typename T>
+    const T* span(int c) const {
+        return (c < 0 || cols_ == nullptr) ? nullptr : static_cast<const T*>(cols_[c]);
+    }
+
+    // 把当前块中 c 列非 NULL 的行复制到 out，返回是否存在 NULL
+    template <typename T>
+    bool compact(int c, std::vector<T>& out) const {
+        const T* data = span<T>(c);
+        out.clear();
+        bool has_null = false;
+        for (int r = 0; r < rows_; ++r) {
+            if (taos_is_null(res_, r, c)) {
+                has_null = true;
+            } else {
+                out.push_back(data[r]);
+            }
+        }
+        return has_null;
+    }
+
+private:
+    TAOS_RES* res_;
+    TAOS_FIELD* fields_ = nullptr;
+    int num_fields_ = 0;
+    TAOS_ROW cols_ = nullptr;
+    int rows_ = 0;
+};
+
+// 天体观测结果的列视图：ra/dec/mag 为 DOUBLE，ts 为毫秒时间戳，结果中没有的列为 nullptr
+struct SkyColumns {
+    const double* ra = nullptr;
+    const double* dec = nullptr;
+    const double* mag = nullptr;
+    const int64_t* ts = nullptr;
+    const int64_t* source_id = nullptr;
+    size_t rows = 0;
+
+    static SkyColumns of(const BlockResultReader& reader) {
+        SkyColumns cols;
+        cols.ra = reader.span<double>(reader.column("ra", TSDB_DATA_TYPE_DOUBLE));
+        cols.dec = reader.span<double>(reader.column("dec", TSDB_DATA_TYPE_DOUBLE));
+        cols.mag = reader.span<double>(reader.column("mag", TSDB_DATA_TYPE_DOUBLE));
+        cols.ts = reader.span<int64_t>(reader.column("ts", TSDB_DATA_TYPE_TIMESTAMP));
+        cols.source_id = reader.span<int64_t>(reader.column("source_id", TSDB_DATA_TYPE_BIGINT));
+        cols.rows = static_cast<size_t>(reader.rows());
+        return cols;
+    }
+
+    bool hasPositions() const { return ra != nullptr && dec != nullptr; }
+};
+
+// 精确 k 近邻（按源计）：从目标所在基础像素出发，按 Healpix_Base::neighbors 逐圈向外扩展，
+// 每个源只保留离目标最近的一次观测作为候选。每取完一圈，计算下一圈像素与目标距离的下界
+// （到像素中心的距离减去 max_pixrad），第 k 近的源已不大于该下界时停止，结果精确且取数像素最少。
+// 本类只维护状态，不做 I/O：调用方循环 nextRing() 取像素条件 -> 查询 -> addCandidates()，同步和异步路径共用。
+class KnnSearch {
+public:
+    struct Neighbor {
+        double dot;  // 与目标的夹角余弦，越大越近
+        double ra;   // 该源离目标最近的一次观测
+        double dec;
+        int64_t source_id;
+        double distanceDeg() const { return ConeFilter::dotToDegrees(dot); }
+    };
+
+    KnnSearch(const HealpixPartition& partition, double ra_deg, double dec_deg, size_t k)
+        : partition_(partition), filter_(ra_deg, dec_deg, 0.0), k_(std::max<size_t>(1, k)) {
+        pointing pt(kDeg2Rad * (90.0 - dec_deg), kDeg2Rad * ra_deg);
+        target_ = pt.to_vec3();
+        pixrad_ = partition_.base().max_pixrad();
+        long center = partition_.base().ang2pix(pt);
+        frontier_.push_back(center);
+        visited_.insert(center);
+    }
+
+    // 取下一圈待查询的基础像素；搜索结束时返回 false
+    bool nextRing(std::vector<long>& ring) {
+        ring.clear();
+        if (rings_ > 0) {
+            // 由上一圈扩展出未访问过的邻居
+            std::vector<long> next;
+            fix_arr<int, 8> nb;
+            for (long pix : frontier_) {
+                partition_.base().neighbors(static_cast<int>(pix), nb);
+                for (size_t i = 0; i < nb.size(); ++i) {
+                    if (nb[i] >= 0 && visited_.insert(nb[i]).second) next.push_back(nb[i]);
+                }
+            }
+            frontier_.swap(next);
+        }
+        if (frontier_.empty()) return false;
+        if (best_.size() >= k_ && kthDot() >= maxDotBound(frontier_)) {
+            return false;  // 下一圈中任何点都不可能比当前第 k 近更近
+        }
+        ring = frontier_;
+        rings_++;
+        pixels_ += ring.size();
+        return true;
+    }
+
+    // 当前圈的像素条件（细分区块展开为其全部细分像素）
+    std::string ringPredicate(const std::vector<long>& ring, const std::string& column = "healpix_id") const {
+        return partition_.basePredicate(ring, column);
+    }
+
+    // 喂入一块结果的 source_id 与坐标列，同一源只保留最近的观测
+    void addCandidates(const int64_t* source_id, const double* ra, const double* dec, size_t n) {
+        dots_.resize(n);
+        filter_.dots(ra, dec, n, dots_.data());
+        for (size_t i = 0; i < n; ++i) {
+            auto it = best_.find(source_id[i]);
+            if (it == best_.end()) {
+                best_.emplace(source_id[i], Neighbor{dots_[i], ra[i], dec[i], source_id[i]});
+            } else if (dots_[i] > it->second.dot) {
+                it->second = {dots_[i], ra[i], dec[i], source_id[i]};
+            }
+        }
+    }
+
+    // 由近到远的 k 个源
+    std::vector<Neighbor> results() const {
+        std::vector<Neighbor> out;
+        out.reserve(best_.size());
+        for (const auto& pair : best_) out.push_back(pair.second);
+        size_t n = std::min(k_, out.size());
+        std::partial_sort(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(n), out.end(),
+                          [](const Neighbor& a, const Neighbor& b) { return a.dot > b.dot; });
+        out.resize(n);
+        return out;
+    }
+
+    size_t found() const { return std::min(k_, best_.size()); }
+    int rings() const { return rings_; }
+    size_t pixels() const { return pixels_; }
+
+private:
+    static constexpr double kDeg2Rad = 3.14159265358979323846 / 180.0;
+
+    // 第 k 近的源与目标的夹角余弦（调用前需已有至少 k 个源）
+    double kthDot() const {
+        kth_.clear();
+        for (const auto& pair : best_) kth_.push_back(pair.second.dot);
+        std::nth_element(kth_.begin(), kth_.begin() + static_cast<std::ptrdiff_t>(k_ - 1), kth_.end(), std::greater<double>());
+        return kth_[k_ - 1];
+    }
+
+    // 一组像素中任一点与目标夹角余弦的上界（即距离下界）
+    double maxDotBound(const std::vector<long>& ring) const {
+        double min_dist = 3.14159265358979323846;
+        for (long pix : ring) {
+            double c = dotprod(target_, partition_.base().pix2vec(static_cast<int>(pix)));
+            double dist = std::acos(std::max(-1.0, std::min(1.0, c))) - pixrad_;
+            min_dist = std::min(min_dist, dist);
+        }
+        return min_dist <= 0.0 ? 1.0 : std::cos(min_dist);
+    }
+
+    const HealpixPartition& partition_;
+    ConeFilter filter_;
+    size_t k_;
+    vec3 target_;
+    double pixrad_ = 0.0;
+    std::vector<long> frontier_;
+    std::unordered_set<long> visited_;
+    std::unordered_map<int64_t, Neighbor> best_;  // source_id -> 该源最近的观测
+    std::vector<double> dots_;
+    mutable std::vector<double> kth_;
+    int rings_ = 0;
+    size_t pixels_ = 0;
+};
+
+// 像素分块结果缓存：键为 (编码像素标签, 时间窗口条件, 列集合)，值为该像素的列式结果块。
+// 按 LRU 在字节预算和块数上限内淘汰（块数上限对应 configs/healpix_config.py 的
+// QUERY_CONFIG['spatial_cache_size']），并统计命中、未命中与淘汰次数。
+// 锥形查询只取未缓存的像素，取回的行按 healpix_id 切分成块后写入缓存。
+class PixelTileCache {
+public:
+    enum Column : uint32_t { RA = 1, DEC = 2, MAG = 4, TS = 8 };
+
+    struct Tile {
+        std::vector<double> ra, dec, mag;
+        std::vector<int64_t> ts;
+        size_t rows() const { return std::max(ra.size(), std::max(mag.size(), ts.size())); }
+        size_t bytes() const {
+            return sizeof(Tile) + (ra.capacity() + dec.capacity() + mag.capacity()) * sizeof(double) +
+                   ts.capacity() * sizeof(int64_t);
+        }
+    };
+    typedef std::shared_ptr<const Tile> TilePtr;
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t tiles = 0;
+        size_t bytes = 0;
+        double hitRate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+    };
+
+    PixelTileCache(size_t max_bytes, size_t max_tiles = 10000)
+        : max_bytes_(max_bytes), max_tiles_(max_tiles) {}
+
+    TilePtr get(int64_t tag, const std::string& window, uint32_t columns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(Key{tag, window, columns});
+        if (it == index_.end()) {
+            stats_.misses++;
+            return nullptr;
+        }
+        stats_.hits++;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+    }
+
+    void put(int64_t tag, const std::string& window, uint32_t columns, TilePtr tile) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Key key{tag, window, columns};
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            stats_.bytes -= it->second->second->bytes();
+            lru_.erase(it->second);
+            index_.erase(it);
+        }
+        stats_.bytes += tile->bytes();
+        lru_.emplace_front(key, std::move(tile));
+        index_[key] = lru_.begin();
+        while (!lru_.empty() && (stats_.bytes > max_bytes_ || lru_.size() > max_tiles_)) {
+            stats_.bytes -= lru_.back().second->bytes();
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+            stats_.evictions++;
+        }
+        stats_.tiles = lru_.size();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Key {
+        int64_t tag;
+        std::string window;
+        uint32_t columns;
+        bool operator==(const Key& other) const {
+            return tag == other.tag && columns == other.columns && window == other.window;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<int64_t>()(key.tag) ^ (std::hash<std::string>()(key.window) * 31) ^ key.columns;
+        }
+    };
+    typedef std::list<std::pair<Key, TilePtr>> LruList;
+
+    size_t max_bytes_;
+    size_t max_tiles_;
+    LruList lru_;
+    std::unordered_map<Key, LruList::iterator, KeyHash> index_;
+    Stats stats_;
+    mutable std::mutex mutex_;
+};
+
+// 源位置索引：每个子表即每个 (healpix_id, source_id) 一条定长记录（平均位置、观测数、时间跨度），
+// 观测跨越像素边界的源有多条记录。按 (healpix_id, source_id) 排序，由导入器在
+// output/query_results/source_position_index.bin 维护，查询端 mmap 只读。
+// 锥形检索先在索引中按标签区间找出源，只有需要光变曲线时才回表取观测行。
+struct SourceIndexHeader {
+    char magic[8];         // "HPXSIDX1"
+    uint32_t version;
+    uint32_t nside_base;
+    uint32_t nside_fine;
+    uint32_t record_size;
+    uint64_t count;
+    uint8_t reserved[32];
+};
+
+struct SourceIndexRecord {
+    int64_t healpix_id;    // 子表标签，与导入器编码一致
+    int64_t source_id;
+    double ra;             // 平均位置（单位向量平均，跨 RA=0 时不失真）
+    double dec;
+    int64_t first_ts;      // 毫秒时间戳
+    int64_t last_ts;
+    uint32_t count;        // 观测数
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SourceIndexHeader) == 64, "源位置索引文件头须为 64 字节");
+static_assert(sizeof(SourceIndexRecord) == 56, "源位置索引记录须为 56 字节");
+
+inline const char* sourceIndexMagic() { return "HPXSIDX1"; }
+
+// 只读映射的源位置索引
+class SourcePositionIndex {
+public:
+    SourcePositionIndex() = default;
+    SourcePositionIndex(const SourcePositionIndex&) = delete;
+    SourcePositionIndex& operator=(const SourcePositionIndex&) = delete;
+    ~SourcePositionIndex() { close(); }
+
+    bool open(const std::string& path, std::string& error) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "无法打开源位置索引 " + path;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SourceIndexHeader)) {
+            ::close(fd);
+            error = "源位置索引过短: " + path;
+            return false;
+        }
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            error = "无法映射源位置索引: " + path;
+            return false;
+        }
+        data_ = data;
+        size_ = st.st_size;
+        header_ = static_cast<const SourceIndexHeader*>(data_);
+        if (std::memcmp(header_->magic, sourceIndexMagic(), 8) != 0 ||
+            header_->record_size != sizeof(SourceIndexRecord) ||
+            sizeof(SourceIndexHeader) + header_->count * sizeof(SourceIndexRecord) > size_) {
+            close();
+            error = "源位置索引格式无效: " + path;
+            return false;
+        }
+        records_ = reinterpret_cast<const SourceIndexRecord*>(header_ + 1);
+        madvise(data_, size_, MADV_RANDOM);
+        return true;
+    }
+
+    void close() {
+        if (data_) munmap(data_, size_);
+        data_ = nullptr;
+        header_ = nullptr;
+        records_ = nullptr;
+        size_ = 0;
+    }
+
+    bool isOpen() const { return data_ != nullptr; }
+    size_t size() const { return header_ ? header_->count : 0; }
+    int nsideBase() const { return header_ ? static_cast<int>(header_->nside_base) : 0; }
+    int nsideFine() const { return header_ ? static_cast<int>(header_->nside_fine) : 0; }
+    const SourceIndexRecord* begin() const { return records_; }
+    const SourceIndexRecord* end() const { return records_ + size(); }
+
+    // 标签落在 [tag_begin, tag_end) 内的记录区间
+    std::pair<const SourceIndexRecord*, const SourceIndexRecord*> range(int64_t tag_begin, int64_t tag_end) const {
+        auto by_tag = [](const SourceIndexRecord& r, int64_t tag) { return r.healpix_id < tag; };
+        const SourceIndexRecord* first = std::lower_bound(begin(), end(), tag_begin, by_tag);
+        const SourceIndexRecord* last = std::lower_bound(first, end(), tag_end, by_tag);
+        return {first, last};
+    }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    const SourceIndexHeader* header_ = nullptr;
+    const SourceIndexRecord* records_ = nullptr;
+};
+
+// 导入端累加器：按 (标签, 源) 即按子表累加单位向量与时间范围，可并入已有索引（追加导入），最后按序写出
+class SourceIndexBuilder {
+public:
+    void add(int64_t source_id, int64_t healpix_id, double ra_deg, double dec_deg, int64_t ts_ms) {
+        Accumulator& acc = tables_[{healpix_id, source_id}];
+        double ra = ra_deg * kDeg2Rad;
+        double dec = dec_deg * kDeg2Rad;
+        acc.add(std::cos(dec) * std::cos(ra), std::cos(dec) * std::sin(ra), std::sin(dec), ts_ms, ts_ms, 1);
+    }
+
+    // 并入已有索引（按观测数加权）
+    bool merge(const std::string& path, std::string& error) {
+        SourcePositionIndex index;
+        if (!index.open(path, error)) return false;
+        for (const SourceIndexRecord* r = index.begin(); r != index.end(); ++r) {
+            double ra = r->ra * kDeg2Rad;
+            double dec = r->dec * kDeg2Rad;
+            tables_[{r->healpix_id, r->source_id}].add(r->count * std::cos(dec) * std::cos(ra),
+                                                      r->count * std::cos(dec) * std::sin(ra),
+                                                      r->count * std::sin(dec), r->first_ts, r->last_ts, r->count);
+        }
+        return true;
+    }
+
+    size_t size() const { return tables_.size(); }
+
+    // 先写临时文件再改名，查询端映射的旧文件不受影响
+    bool save(const std::string& path, int nside_base, int nside_fine) const {
+        std::vector<SourceIndexRecord> records;
+        records.reserve(tables_.size());
+        for (const auto& pair : tables_) {
+            const Accumulator& acc = pair.second;
+            SourceIndexRecord r{};
+            r.healpix_id = pair.first.first;
+            r.source_id = pair.first.second;
+            double ra = std::atan2(acc.y, acc.x) / kDeg2Rad;
+            if (ra < 0) ra += 360.0;
+            r.ra = ra >= 360.0 ? 0.0 : ra;
+            r.dec = std::atan2(acc.z, std::sqrt(acc.x * acc.x + acc.y * acc.y)) / kDeg2Rad;
+            r.first_ts = acc.first_ts;
+            r.last_ts = acc.last_ts;
+            r.count = acc.count;
+            records.push_back(r);
+        }
+
+        SourceIndexHeader header{};
+        std::memcpy(header.magic, sourceIndexMagic(), 8);
+        header.version = 1;
+        header.nside_base = nside_base;
+        header.nside_fine = nside_fine;
+        header.record_size = sizeof(SourceIndexRecord);
+        header.count = records.size();
+
+        std::string tmp_path = path + ".tmp";
+        std::ofstream out(tmp_path, std::ios::binary);
+        if (!out.is_open()) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SourceIndexRecord));
+        out.close();
+        if (!out) return false;
+        return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct Accumulator {
+        double x = 0, y = 0, z = 0;
+        int64_t first_ts = 0;
+        int64_t last_ts = 0;
+        uint32_t count = 0;
+
+        void add(double dx, double dy, double dz, int64_t first, int64_t last, uint32_t n) {
+            first_ts = count ? std::min(first_ts, first) : first;
+            last_ts = count ? std::max(last_ts, last) : last;
+            x += dx;
+            y += dy;
+            z += dz;
+            count += n;
+        }
+    };
+    static constexpr double kDeg2Rad = 3.14159265358979323846 / 180.0;
+    std::map<std::pair<int64_t, int64_t>, Accumulator> tables_;  // (healpix_id, source_id) 有序，即索引的记录顺序
+};
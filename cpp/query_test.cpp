@@ -27,6 +27,8 @@
 #include <healpix_cxx/rangeset.h>
 #include <healpix_cxx/arr.h>
 
+#include "healpix_common.h"
+
 const double PI = 3.14159265358979323846;
 
 // 度数转弧度函数
@@ -69,7 +71,10 @@ struct AsyncQueryContext {
     
     // 结果存储
     std::vector<std::pair<double, double>> coordinates;
-    int result_count;
+    int result_count;       // 锥形查询为圆盘内的行数，其余为返回行数
+    int fetched_rows = 0;   // 服务端返回的行数
+    std::unique_ptr<ConeFilter> filter;  // 锥形查询的批量筛选
+    std::unique_ptr<KnnSearch> knn;      // 最近邻查询的逐圈扩展状态，每圈一次异步查询
     bool query_completed;
     bool query_success;
     std::string error_message;
@@ -94,6 +99,9 @@ struct AsyncQueryContext {
           result_count(0), query_completed(false), query_success(false),
           query_execution_ms(0), result_fetch_ms(0), total_ms(0) {
         query_start_time = std::chrono::high_resolution_clock::now();
+        if (query_type.rfind("cone_", 0) == 0) {
+            filter = std::make_unique<ConeFilter>(ra, dec, r);
+        }
     }
     
     void markQueryCallback() {
@@ -122,16 +130,22 @@ void async_fetch_callback(void* param, TAOS_RES* res, int numOfRows);
 class AsyncTDengineQueryTester {
 private:
     TAOS* conn;
+    std::vector<TAOS*> conns;             // 异步查询分散到多条连接，conn 即 conns[0]
+    std::atomic<size_t> next_conn{0};
     std::string db_name;
     std::string table_name;
     int nside;
     std::unique_ptr<Healpix_Base> healpix_map;
+    HealpixPartition partition;
     std::vector<TestData> test_coords_5k;
     std::vector<TestData> test_coords_100;
+    size_t knn_k = 1;  // 最近邻查询返回的近邻数
     
-    // 异步查询管理
+    // 异步查询管理：在途查询数由回调在完成时递减并唤醒提交线程，提交线程随完随补，无批次屏障
     std::atomic<int> active_queries{0};
     std::atomic<int> completed_queries{0};
+    std::mutex inflight_mutex;
+    std::condition_variable inflight_cv;
     std::vector<std::unique_ptr<AsyncQueryContext>> query_contexts;
     std::mutex contexts_mutex;
     
@@ -156,14 +170,29 @@ public:
                            int port = 6030,
                            const std::string& database = "test_db",
                            const std::string& table = "sensor_data",
-                           int nside_param = 64)
-        : conn(nullptr), db_name(database), table_name(table), nside(nside_param) {
+                           int nside_param = 64,
+                           int connection_count = 4,
+                           const std::string& partition_map_path = "output/query_results/healpix_partition_map.csv")
+        : conn(nullptr), db_name(database), table_name(table), nside(nside_param), partition(nside_param) {
         
         std::cout << "🔧 正在初始化 HealPix..." << std::endl;
         // 初始化 HealPix
         healpix_map = std::make_unique<Healpix_Base>(nside, NEST, SET_NSIDE);
         std::cout << "✅ HealPix 初始化成功，NSIDE=" << nside << std::endl;
         
+        // 读取导入器的分区表：细分区块按 (base << 32) + fine 编码查询
+        std::string partition_error;
+        if (partition.load(partition_map_path, partition_error)) {
+            if (partition.nsideBase() != nside) {
+                nside = partition.nsideBase();
+                healpix_map = std::make_unique<Healpix_Base>(nside, NEST, SET_NSIDE);
+            }
+            std::cout << "✅ 已加载分区表: " << partition.refinedCount() << " 个细分区块 (NSIDE="
+                     << nside << "/" << partition.nsideFine() << ")" << std::endl;
+        } else {
+            std::cout << "⚠️ " << partition_error << "，全部区块按 NSIDE=" << nside << " 查询" << std::endl;
+        }
+        
         std::cout << "🔧 正在初始化 TDengine..." << std::endl;
         // 初始化 TDengine
         taos_init();
@@ -173,10 +202,15 @@ public:
         std::cout << "🔗 正在连接数据库 " << database << "..." << std::endl;
         
         // 连接数据库
-        conn = taos_connect(host.c_str(), user.c_str(), password.c_str(), database.c_str(), port);
-        if (conn == nullptr) {
-            throw std::runtime_error("无法连接到 TDengine: " + std::string(taos_errstr(conn)));
+        for (int i = 0; i < std::max(1, connection_count); ++i) {
+            TAOS* c = taos_connect(host.c_str(), user.c_str(), password.c_str(), database.c_str(), port);
+            if (c == nullptr) {
+                for (TAOS* opened : conns) taos_close(opened);
+                throw std::runtime_error("无法连接到 TDengine: " + std::string(taos_errstr(c)));
+            }
+            conns.push_back(c);
         }
+        conn = conns[0];
         
         // 记录连接结束时间
         connection_end_time = std::chrono::high_resolution_clock::now();
@@ -184,20 +218,17 @@ public:
         auto connection_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
             connection_end_time - connection_start_time);
         
-        std::cout << "✅ TDengine 连接成功，耗时: " << connection_duration.count() << " ms" << std::endl;
+        std::cout << "✅ TDengine 连接成功 (" << conns.size() << " 条连接)，耗时: "
+                 << connection_duration.count() << " ms" << std::endl;
     }
     
     ~AsyncTDengineQueryTester() {
         std::cout << "🔄 正在清理资源..." << std::endl;
-        // 等待所有异步查询完成
-        int wait_count = 0;
-        while (active_queries > 0 && wait_count < 300) {  // 最多等30秒
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            wait_count++;
-        }
+        // 等待所有异步查询完成，最多等30秒
+        waitForInFlight(0, std::chrono::seconds(30));
         
-        if (conn) {
-            taos_close(conn);
+        for (TAOS* c : conns) {
+            taos_close(c);
         }
         taos_cleanup();
         std::cout << "✅ 资源清理完成" << std::endl;
@@ -283,6 +314,47 @@ public:
         return true;
     }
     
+    // 阻塞直到在途查询数低于 limit，然后占用一个名额
+    void acquireQuerySlot(int limit) {
+        std::unique_lock<std::mutex> lock(inflight_mutex);
+        inflight_cv.wait(lock, [&] { return active_queries.load() < limit; });
+        active_queries++;
+    }
+    
+    // 由回调在查询结束（成功或失败）时调用
+    void releaseQuerySlot() {
+        {
+            std::lock_guard<std::mutex> lock(inflight_mutex);
+            active_queries--;
+            completed_queries++;
+        }
+        inflight_cv.notify_all();
+    }
+    
+    bool waitForInFlight(int target, std::chrono::milliseconds timeout = std::chrono::hours(24)) {
+        std::unique_lock<std::mutex> lock(inflight_mutex);
+        return inflight_cv.wait_for(lock, timeout, [&] { return active_queries.load() <= target; });
+    }
+    
+    // 轮询分配连接
+    TAOS* nextConnection() {
+        return conns[next_conn.fetch_add(1, std::memory_order_relaxed) % conns.size()];
+    }
+    
+    // 随完随补地提交 total 个查询：在途数保持在 limit，回调释放名额即补上下一个，最后等待全部完成
+    template <typename Submit>
+    void runPipelined(size_t total, int limit, int report_every, Submit submit) {
+        for (size_t i = 0; i < total; ++i) {
+            acquireQuerySlot(limit);
+            submit(i);
+            if (report_every > 0 && (i + 1) % report_every == 0) {
+                std::cout << "进度: 已提交 " << (i + 1) << "/" << total
+                         << "，已完成 " << completed_queries.load() << std::endl;
+            }
+        }
+        waitForInFlight(0);
+    }
+    
     void executeAsyncNearestQuery(double ra, double dec, int query_id) {
         // 验证和裁剪坐标值到有效范围
         ra = fmod(ra, 360.0);
@@ -292,25 +364,28 @@ public:
         // 创建查询上下文
         auto context = std::make_unique<AsyncQueryContext>("nearest", query_id, ra, dec);
         AsyncQueryContext* ctx_ptr = context.get();
+        ctx_ptr->knn = std::make_unique<KnnSearch>(partition, ra, dec, knn_k);
         
         {
             std::lock_guard<std::mutex> lock(contexts_mutex);
             query_contexts.push_back(std::move(context));
         }
         
-        // 计算 HealPix 邻居
-        pointing pt(deg2rad(90.0 - dec), deg2rad(ra));
-        long center_id = healpix_map->ang2pix(pt);
-        
-        // 构建异步SQL查询
+        // 🔥 此处开始计时：从中心像素开始第一圈查询（名额已由 runPipelined 占用）
+        continueKnnQuery(ctx_ptr);
+    }
+    
+    // 发出最近邻查询的下一圈；已可确定结果时返回 false
+    bool continueKnnQuery(AsyncQueryContext* ctx_ptr) {
+        std::vector<long> ring;
+        if (!ctx_ptr->knn->nextRing(ring)) {
+            return false;
+        }
         std::ostringstream oss;
-        oss << "SELECT ra, dec FROM " << table_name << " WHERE healpix_id = " << center_id << " LIMIT 1000";
-        
-        ctx_ptr->sql_query = oss.str();  // 记录SQL
-        
-        // 执行异步查询 🔥 此处开始计时
-        active_queries++;
-        taos_query_a(conn, oss.str().c_str(), async_query_callback, ctx_ptr);
+        oss << "SELECT source_id, ra, dec FROM " << table_name << " WHERE " << ctx_ptr->knn->ringPredicate(ring);
+        ctx_ptr->sql_query = oss.str();  // 记录SQL（最后一圈）
+        taos_query_a(nextConnection(), ctx_ptr->sql_query.c_str(), async_query_callback, ctx_ptr);
+        return true;
     }
     
     void executeAsyncConeQuery(double ra, double dec, double radius, int query_id) {
@@ -332,30 +407,14 @@ public:
         pointing center_pt(deg2rad(90.0 - dec), deg2rad(ra));
         double radius_rad = deg2rad(radius);
         
-        // 使用query_disc获取锥形区域内的像素
-        std::vector<int> pixels;
-        healpix_map->query_disc(center_pt, radius_rad, pixels);
-        
-        // 如果没有找到像素，至少包含中心像素
-        if (pixels.empty()) {
-            int center_id = healpix_map->ang2pix(center_pt);
-            pixels.push_back(center_id);
-        }
-        
-        // 构建SQL查询
+        // 构建SQL查询：未细分区块用基础像素，细分区块内只取与圆盘相交的细分像素，连续像素段压缩为 BETWEEN
         std::ostringstream oss;
-        oss << "SELECT ra, dec FROM " << table_name << " WHERE healpix_id IN (";
-        for (size_t i = 0; i < pixels.size(); ++i) {
-            if (i > 0) oss << ",";
-            oss << pixels[i];
-        }
-        oss << ")";
+        oss << "SELECT ra, dec FROM " << table_name << " WHERE " << partition.conePredicate(center_pt, radius_rad);
         
         ctx_ptr->sql_query = oss.str();  // 记录SQL
         
         // 执行异步查询
-        active_queries++;
-        taos_query_a(conn, oss.str().c_str(), async_query_callback, ctx_ptr);
+        taos_query_a(nextConnection(), ctx_ptr->sql_query.c_str(), async_query_callback, ctx_ptr);
     }
     
     void executeAsyncTimeQuery(double ra, double dec, const std::string& time_condition, int query_id) {
@@ -380,14 +439,13 @@ public:
         // 构建时间查询SQL
         std::ostringstream oss;
         oss << "SELECT COUNT(*) FROM " << table_name 
-            << " WHERE healpix_id = " << center_id 
+            << " WHERE " << partition.basePredicate({center_id})
             << " AND " << time_condition;
         
         ctx_ptr->sql_query = oss.str();  // 记录SQL
         
         // 执行异步查询
-        active_queries++;
-        taos_query_a(conn, oss.str().c_str(), async_query_callback, ctx_ptr);
+        taos_query_a(nextConnection(), ctx_ptr->sql_query.c_str(), async_query_callback, ctx_ptr);
     }
     
     void runAsyncNearestNeighborTest() {
@@ -398,39 +456,15 @@ public:
         // 重置计数器
         completed_queries = 0;
         
-        // 🔥 并发执行多个查询
+        // 🔥 并发执行多个查询：在途数保持 concurrent_queries，完成一个补一个
         int concurrent_queries = 20;  // 同时执行20个查询
-        int batch_size = 50;          // 每批50个查询
-        int total_batches = (test_coords_5k.size() + batch_size - 1) / batch_size;
         
         std::cout << "📊 测试配置: 并发数=" << concurrent_queries 
-                 << ", 批大小=" << batch_size 
-                 << ", 总批数=" << total_batches << std::endl;
+                 << ", 连接数=" << conns.size() << ", k=" << knn_k << std::endl;
         
-        for (int batch = 0; batch < total_batches; ++batch) {
-            int start_idx = batch * batch_size;
-            int end_idx = std::min(start_idx + batch_size, static_cast<int>(test_coords_5k.size()));
-            
-            std::cout << "--- 批次 " << (batch + 1) << "/" << total_batches 
-                     << " (查询 " << start_idx << "-" << (end_idx-1) << ") ---" << std::endl;
-            
-            // 启动一批查询
-            for (int i = start_idx; i < end_idx; ++i) {
-                // 控制并发数
-                while (active_queries >= concurrent_queries) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
-                }
-                
-                executeAsyncNearestQuery(test_coords_5k[i].ra, test_coords_5k[i].dec, i);
-            }
-            
-            // 等待当前批次完成
-            while (active_queries > 0) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            }
-            
-            std::cout << "✅ 批次 " << (batch + 1) << " 完成，总完成: " << completed_queries.load() << std::endl;
-        }
+        runPipelined(test_coords_5k.size(), concurrent_queries, 500, [&](size_t i) {
+            executeAsyncNearestQuery(test_coords_5k[i].ra, test_coords_5k[i].dec, static_cast<int>(i));
+        });
         
         auto end_time = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
@@ -452,23 +486,9 @@ public:
             
             int concurrent_queries = 15;  // 锥形查询更复杂，降低并发数
             
-            for (size_t i = 0; i < test_coords_100.size(); ++i) {
-                // 控制并发数
-                while (active_queries >= concurrent_queries) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                }
-                
-                executeAsyncConeQuery(test_coords_100[i].ra, test_coords_100[i].dec, radius, i);
-                
-                if ((i + 1) % 20 == 0) {
-                    std::cout << "进度: " << (i + 1) << "/" << test_coords_100.size() << std::endl;
-                }
-            }
-            
-            // 等待所有查询完成
-            while (active_queries > 0) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            }
+            runPipelined(test_coords_100.size(), concurrent_queries, 20, [&](size_t i) {
+                executeAsyncConeQuery(test_coords_100[i].ra, test_coords_100[i].dec, radius, static_cast<int>(i));
+            });
             
             auto end_time = std::chrono::high_resolution_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
@@ -507,23 +527,9 @@ public:
             
             int concurrent_queries = 25;  // 时间查询较快，可以更高并发
             
-            for (size_t i = 0; i < test_coords_5k.size(); ++i) {
-                // 控制并发数
-                while (active_queries >= concurrent_queries) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
-                }
-                
-                executeAsyncTimeQuery(test_coords_5k[i].ra, test_coords_5k[i].dec, condition.second, i);
-                
-                if ((i + 1) % 100 == 0) {
-                    std::cout << "进度: " << (i + 1) << "/" << test_coords_5k.size() << std::endl;
-                }
-            }
-            
-            // 等待所有查询完成
-            while (active_queries > 0) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            }
+            runPipelined(test_coords_5k.size(), concurrent_queries, 1000, [&](size_t i) {
+                executeAsyncTimeQuery(test_coords_5k[i].ra, test_coords_5k[i].dec, condition.second, static_cast<int>(i));
+            });
             
             auto end_time = std::chrono::high_resolution_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
@@ -625,10 +631,10 @@ void async_query_callback(void* param, TAOS_RES* res, int code) {
         context->error_message = taos_errstr(res);
         context->query_completed = true;
         context->markFetchEnd();
+        taos_free_result(res);  // 在释放名额之前归还结果集，持续补充查询时不累积未释放的结果
         
         if (g_tester) {
-            g_tester->active_queries--;
-            g_tester->completed_queries++;
+            g_tester->releaseQuerySlot();
         }
         
         context->result_cv.notify_one();
@@ -647,9 +653,8 @@ void async_query_callback(void* param, TAOS_RES* res, int code) {
         context->markFetchEnd();
         
         if (g_tester) {
-            g_tester->active_queries--;
-            g_tester->completed_queries++;
             g_tester->addPerformanceStats(context->query_type, context->query_execution_ms, context->result_fetch_ms, 0);
+            g_tester->releaseQuerySlot();
         }
         
         context->result_cv.notify_one();
@@ -671,10 +676,10 @@ void async_fetch_callback(void* param, TAOS_RES* res, int numOfRows) {
         context->error_message = taos_errstr(res);
         context->query_completed = true;
         context->markFetchEnd();
+        taos_free_result(res);
         
         if (g_tester) {
-            g_tester->active_queries--;
-            g_tester->completed_queries++;
+            g_tester->releaseQuerySlot();
         }
         
         context->result_cv.notify_one();
@@ -682,30 +687,51 @@ void async_fetch_callback(void* param, TAOS_RES* res, int numOfRows) {
     }
     
     if (numOfRows == 0) {
+        // 最近邻查询：本圈取完，需要时继续下一圈，名额保持占用
+        if (context->knn) {
+            taos_free_result(res);
+            res = nullptr;
+            if (g_tester && g_tester->continueKnnQuery(context)) {
+                return;
+            }
+            context->result_count = static_cast<int>(context->knn->found());
+        }
+        
         // 所有结果获取完毕 🔥 记录完成时间和统计
         std::lock_guard<std::mutex> lock(context->result_mutex);
         
         context->query_success = true;
         context->query_completed = true;
         context->markFetchEnd();
+        if (res) taos_free_result(res);
         
         if (g_tester) {
-            g_tester->active_queries--;
-            g_tester->completed_queries++;
             g_tester->addPerformanceStats(
                 context->query_type,
                 context->query_execution_ms, 
                 context->result_fetch_ms, 
                 context->result_count
             );
+            g_tester->releaseQuerySlot();
         }
         
         context->result_cv.notify_one();
         return;
     }
     
-    // 处理当前批次的结果
-    context->result_count += numOfRows;  // 累加结果数量
+    // 处理当前批次的结果：按块取列，坐标列直接交给批量筛选
+    context->fetched_rows += numOfRows;
+    BlockResultReader reader(res);
+    reader.bind(numOfRows);
+    SkyColumns cols = SkyColumns::of(reader);
+    if (context->knn && cols.hasPositions() && cols.source_id) {
+        context->knn->addCandidates(cols.source_id, cols.ra, cols.dec, cols.rows);
+    } else if (context->filter && cols.hasPositions()) {
+        std::vector<uint8_t> inside;
+        context->result_count += static_cast<int>(context->filter->mask(cols.ra, cols.dec, cols.rows, inside));
+    } else {
+        context->result_count += numOfRows;  // 累加结果数量
+    }
     
     // 继续获取下一批结果
     taos_fetch_rows_a(res, async_fetch_callback, param);
@@ -11,6 +11,12 @@
 #include <memory>
 #include <algorithm>
 #include <map>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
 
 // TDengine 头文件
 #include <taos.h>
@@ -22,6 +28,8 @@
 #include <healpix_cxx/rangeset.h>
 #include <healpix_cxx/arr.h>
 
+#include "healpix_common.h"
+
 const double PI = 3.14159265358979323846;
 
 // 度数转弧度函数
@@ -54,13 +62,600 @@ struct TestData {
     double ra, dec;
 };
 
+// 外部星表交叉匹配的一个目标
+struct CrossMatchTarget {
+    int64_t id;
+    double ra, dec;
+};
+
+// 匹配对输出：CSV，或定长二进制记录
+// (int64 target_id, int64 source_id, double ra, double dec, double sep_arcsec，小端，每条 40 字节)
+class CrossMatchSink {
+public:
+    enum class Format { CSV, BINARY };
+    
+    CrossMatchSink(const std::string& path, Format format) : format_(format) {
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) std::filesystem::create_directories(parent);
+        out_.open(path, format == Format::BINARY ? std::ios::binary : std::ios::out);
+        if (out_.is_open() && format_ == Format::CSV) {
+            out_ << "target_id,source_id,target_ra,target_dec,ra,dec,sep_arcsec\n";
+            out_ << std::setprecision(10);
+        }
+    }
+    
+    bool ok() const { return out_.is_open(); }
+    size_t written() const { return written_; }
+    
+    void write(const CrossMatchTarget& target, int64_t source_id, double ra, double dec, double sep_arcsec) {
+        if (format_ == Format::CSV) {
+            out_ << target.id << "," << source_id << "," << target.ra << "," << target.dec << ","
+                 << ra << "," << dec << "," << sep_arcsec << "\n";
+        } else {
+            struct {
+                int64_t target_id;
+                int64_t source_id;
+                double ra, dec, sep_arcsec;
+            } record{target.id, source_id, ra, dec, sep_arcsec};
+            out_.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+        written_++;
+    }
+    
+private:
+    Format format_;
+    std::ofstream out_;
+    size_t written_ = 0;
+};
+
+// 批量交叉匹配：目标按基础像素分桶，每个桶需要自身及 8 个邻居像素中的源位置。
+// 每个像素只查询一次（多条连接按桶顺序并行预取，预取窗口限制内存），像素内用批量点积筛选，
+// 匹配对流式写出。开销随涉及的像素数而不是目标数增长。
+class CatalogCrossMatcher {
+public:
+    struct Options {
+        double radius_arcsec = 1.0;
+        bool all_within = false;   // false 只输出最近的一个源
+        int connections = 4;
+        size_t lookahead = 256;    // 预取领先匹配的桶数
+    };
+    
+    CatalogCrossMatcher(const std::string& host, const std::string& user, const std::string& password,
+                        int port, const std::string& database, const std::string& table,
+                        const HealpixPartition& partition, const Options& options)
+        : host_(host), user_(user), password_(password), port_(port), database_(database),
+          table_(table), partition_(partition), options_(options) {}
+    
+    // 读取星表 CSV：首行为表头，前三列为 id,ra,dec；id 非整数时使用行号
+    static bool loadCatalog(const std::string& path, std::vector<CrossMatchTarget>& targets) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cerr << "❌ 无法打开星表: " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        std::getline(file, line);
+        int64_t line_no = 0;
+        while (std::getline(file, line)) {
+            line_no++;
+            char* end = nullptr;
+            const char* p = line.c_str();
+            int64_t id = std::strtoll(p, &end, 10);
+            if (end == p || *end != ',') id = line_no;
+            size_t c1 = line.find(',');
+            if (c1 == std::string::npos) continue;
+            size_t c2 = line.find(',', c1 + 1);
+            double ra = std::strtod(p + c1 + 1, nullptr);
+            double dec = c2 == std::string::npos ? NAN : std::strtod(p + c2 + 1, nullptr);
+            if (std::isnan(dec)) continue;
+            ra = fmod(ra, 360.0);
+            if (ra < 0) ra += 360.0;
+            targets.push_back({id, ra, std::max(-90.0, std::min(90.0, dec))});
+        }
+        std::cout << "📥 已读取星表: " << targets.size() << " 个目标" << std::endl;
+        return true;
+    }
+    
+    bool run(const std::vector<CrossMatchTarget>& targets, CrossMatchSink& sink) {
+        const Healpix_Base& base = partition_.base();
+        double radius_deg = options_.radius_arcsec / 3600.0;
+        // 8 邻域只覆盖到约半个像素边长的距离
+        double half_side_deg = 0.5 * std::sqrt(4.0 * PI / base.Npix()) * 180.0 / PI;
+        if (radius_deg > half_side_deg) {
+            std::cerr << "❌ 匹配半径 " << options_.radius_arcsec << " 角秒超过 NSIDE=" << base.Nside()
+                     << " 像素半边长 (" << half_side_deg * 3600.0 << " 角秒)" << std::endl;
+            return false;
+        }
+        auto start_time = std::chrono::high_resolution_clock::now();
+        
+        // 1. 按基础像素分桶
+        std::vector<std::pair<long, uint32_t>> keyed(targets.size());
+        for (size_t i = 0; i < targets.size(); ++i) {
+            pointing pt(deg2rad(90.0 - targets[i].dec), deg2rad(targets[i].ra));
+            keyed[i] = {base.ang2pix(pt), static_cast<uint32_t>(i)};
+        }
+        std::sort(keyed.begin(), keyed.end());
+        std::vector<Bucket> buckets;
+        for (size_t i = 0; i < keyed.size(); ++i) {
+            if (buckets.empty() || buckets.back().pixel != keyed[i].first) {
+                buckets.push_back({keyed[i].first, i, i, {}});
+            }
+            buckets.back().end = i + 1;
+        }
+        
+        // 2. 每个桶需要的像素，按桶顺序排出取数序列和引用计数
+        for (auto& bucket : buckets) {
+            fix_arr<int, 8> nb;
+            base.neighbors(static_cast<int>(bucket.pixel), nb);
+            bucket.needed.push_back(bucket.pixel);
+            for (size_t k = 0; k < nb.size(); ++k) {
+                if (nb[k] >= 0 && std::find(bucket.needed.begin(), bucket.needed.end(), nb[k]) == bucket.needed.end()) {
+                    bucket.needed.push_back(nb[k]);
+                }
+            }
+            for (long pix : bucket.needed) {
+                if (refcount_[pix]++ == 0) sequence_.push_back(pix);
+            }
+            bucket.need_end = sequence_.size();
+        }
+        std::cout << "🧮 交叉匹配: " << targets.size() << " 个目标，" << buckets.size() << " 个桶，"
+                 << sequence_.size() << " 个像素，" << options_.connections << " 条连接" << std::endl;
+        
+        // 3. 预取线程：每条连接一个线程，按序领取像素
+        buckets_ = &buckets;
+        fetch_cursor_ = 0;
+        current_bucket_ = 0;
+        std::vector<std::thread> fetchers;
+        for (int c = 0; c < std::max(1, options_.connections); ++c) {
+            fetchers.emplace_back(&CatalogCrossMatcher::fetchLoop, this);
+        }
+        
+        // 4. 按桶顺序匹配
+        size_t matched_targets = 0;
+        std::vector<double> dots;
+        std::unordered_map<int64_t, WithinMatch> within;  // --all：按 source_id 去重，保留最近的一条
+        for (size_t b = 0; b < buckets.size(); ++b) {
+            const Bucket& bucket = buckets[b];
+            std::vector<const PixelRows*> pixels;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] {
+                    for (long pix : bucket.needed) {
+                        if (!loaded_.count(pix)) return false;
+                    }
+                    return true;
+                });
+                for (long pix : bucket.needed) pixels.push_back(&loaded_[pix]);
+            }
+            for (size_t t = bucket.begin; t < bucket.end; ++t) {
+                const CrossMatchTarget& target = targets[keyed[t].second];
+                ConeFilter filter(target.ra, target.dec, 0.0);
+                double cos_radius = std::cos(radius_deg * PI / 180.0);
+                double best_dot = -2.0;
+                const PixelRows* best_rows = nullptr;
+                size_t best_index = 0;
+                within.clear();
+                for (const PixelRows* rows : pixels) {
+                    size_t n = rows->ra.size();
+                    dots.resize(n);
+                    filter.dots(rows->ra.data(), rows->dec.data(), n, dots.data());
+                    for (size_t r = 0; r < n; ++r) {
+                        if (dots[r] <= cos_radius) continue;  // 与 ConeFilter 一致，边界上的点不算在内
+                        if (options_.all_within) {
+                            // 源在相邻像素各有子表时会出现多次
+                            WithinMatch& match = within[rows->source_id[r]];
+                            if (dots[r] > match.dot) match = {dots[r], rows->ra[r], rows->dec[r]};
+                        }
+                        if (dots[r] > best_dot) {
+                            best_dot = dots[r];
+                            best_rows = rows;
+                            best_index = r;
+                        }
+                    }
+                }
+                if (!within.empty()) {
+                    std::vector<std::pair<int64_t, WithinMatch>> ordered(within.begin(), within.end());
+                    std::sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) {
+                        return a.second.dot > b.second.dot;  // 由近到远
+                    });
+                    for (const auto& pair : ordered) {
+                        sink.write(target, pair.first, pair.second.ra, pair.second.dec,
+                                   ConeFilter::dotToDegrees(pair.second.dot) * 3600.0);
+                    }
+                }
+                if (best_rows) {
+                    matched_targets++;
+                    if (!options_.all_within) {
+                        sink.write(target, best_rows->source_id[best_index], best_rows->ra[best_index],
+                                   best_rows->dec[best_index], ConeFilter::dotToDegrees(best_dot) * 3600.0);
+                    }
+                }
+            }
+            // 释放不再被后续桶需要的像素，推进预取窗口
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (long pix : bucket.needed) {
+                    if (--refcount_[pix] == 0) loaded_.erase(pix);
+                }
+                current_bucket_ = b + 1;
+            }
+            cv_.notify_all();
+            
+            if ((b + 1) % 1000 == 0 || b + 1 == buckets.size()) {
+                std::cout << "交叉匹配进度: " << (b + 1) << "/" << buckets.size() << " 个桶，已匹配 "
+                         << matched_targets << " 个目标" << std::endl;
+            }
+        }
+        for (auto& fetcher : fetchers) fetcher.join();
+        
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - start_time);
+        std::cout << "✅ 交叉匹配完成: " << matched_targets << "/" << targets.size() << " 个目标有匹配，输出 "
+                 << sink.written() << " 对；查询 " << sequence_.size() << " 个像素 ("
+                 << fetched_rows_.load() << " 个源，失败 " << failed_pixels_.load() << " 个像素)，耗时 "
+                 << (duration.count() / 1000.0) << " 秒" << std::endl;
+        return failed_pixels_.load() == 0;
+    }
+    
+private:
+    struct Bucket {
+        long pixel;
+        size_t begin, end;        // 排序后目标下标区间
+        std::vector<long> needed; // 自身及邻居像素
+        size_t need_end = 0;      // 本桶所需像素在取数序列中的结束位置
+    };
+    
+    struct PixelRows {
+        std::vector<int64_t> source_id;
+        std::vector<double> ra, dec;
+    };
+    
+    struct WithinMatch {
+        double dot = -2.0;
+        double ra = 0;
+        double dec = 0;
+    };
+    
+    std::string host_, user_, password_;
+    int port_;
+    std::string database_, table_;
+    const HealpixPartition& partition_;
+    Options options_;
+    
+    std::vector<long> sequence_;
+    std::unordered_map<long, int> refcount_;
+    std::unordered_map<long, PixelRows> loaded_;
+    const std::vector<Bucket>* buckets_ = nullptr;
+    size_t fetch_cursor_ = 0;
+    size_t current_bucket_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<size_t> fetched_rows_{0};
+    std::atomic<size_t> failed_pixels_{0};
+    
+    void fetchLoop() {
+        TAOS* conn = taos_connect(host_.c_str(), user_.c_str(), password_.c_str(), database_.c_str(), port_);
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                // 只预取到领先当前桶 lookahead 个桶所需的位置
+                cv_.wait(lock, [&] {
+                    if (fetch_cursor_ >= sequence_.size()) return true;
+                    size_t window = std::min(current_bucket_ + options_.lookahead, buckets_->size() - 1);
+                    return fetch_cursor_ < (*buckets_)[window].need_end;
+                });
+                if (fetch_cursor_ >= sequence_.size()) break;
+                index = fetch_cursor_++;
+            }
+            long pixel = sequence_[index];
+            PixelRows rows;
+            if (!conn || !fetchPixel(conn, pixel, rows)) {
+                failed_pixels_++;
+            }
+            fetched_rows_ += rows.ra.size();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                loaded_[pixel] = std::move(rows);
+            }
+            cv_.notify_all();
+        }
+        if (conn) taos_close(conn);
+    }
+    
+    // 每个源取平均位置（与源位置索引一致，不受单次观测误差影响）
+    bool fetchPixel(TAOS* conn, long pixel, PixelRows& rows) {
+        std::ostringstream oss;
+        oss << "SELECT source_id, AVG(ra) AS ra, AVG(dec) AS dec FROM " << table_
+            << " WHERE " << partition_.basePredicate({pixel}) << " PARTITION BY source_id";
+        TAOS_RES* result = taos_query(conn, oss.str().c_str());
+        if (taos_errno(result) != 0) {
+            std::cerr << "交叉匹配查询错误 (像素 " << pixel << "): " << taos_errstr(result) << std::endl;
+            taos_free_result(result);
+            return false;
+        }
+        BlockResultReader reader(result);
+        int id_col = reader.column("source_id", TSDB_DATA_TYPE_BIGINT);
+        while (reader.next() > 0) {
+            SkyColumns cols = SkyColumns::of(reader);
+            const int64_t* ids = reader.span<int64_t>(id_col);
+            if (!cols.hasPositions() || !ids) break;
+            rows.source_id.insert(rows.source_id.end(), ids, ids + cols.rows);
+            rows.ra.insert(rows.ra.end(), cols.ra, cols.ra + cols.rows);
+            rows.dec.insert(rows.dec.end(), cols.dec, cols.dec + cols.rows);
+        }
+        taos_free_result(result);
+        return true;
+    }
+};
+
+// 按 source_id 批量取回的光变曲线：各列连续存放，第 i 个源的观测为 [offsets[i], offsets[i+1])，按时间升序
+struct LightCurveSet {
+    std::vector<int64_t> source_ids;
+    std::vector<size_t> offsets;
+    std::vector<int64_t> ts;
+    std::vector<double> ra, dec, mag;
+    size_t missing = 0;  // 库中没有子表的源（行数为 0）
+    
+    size_t sources() const { return source_ids.size(); }
+    size_t rows() const { return ts.size(); }
+    size_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+    size_t bytes() const { return rows() * (sizeof(int64_t) + 3 * sizeof(double)); }
+};
+
+// 光变曲线批量取数：直接查询子表而不在超级表上按标签过滤。一个源的观测可能分布在多个子表
+// （跨像素边界或追加时落入新标签），首次用到时按 source_id 批量查出全部 (healpix_id, source_id) 并缓存。
+// 每条语句用 UNION ALL 合并若干子表，常量列 slot 标明行属于哪个源；语句分批由连接池中的连接并行执行。
+class LightCurveFetcher {
+public:
+    struct Options {
+        int connections = 4;
+        size_t tables_per_query = 64;
+    };
+    
+    struct Key {
+        int64_t source_id;
+        int64_t healpix_id;
+    };
+    
+    LightCurveFetcher(const std::string& host, const std::string& user, const std::string& password,
+                      int port, const std::string& database, const std::string& table, const Options& options)
+        : table_(table), options_(options) {
+        for (int c = 0; c < std::max(1, options_.connections); ++c) {
+            TAOS* conn = taos_connect(host.c_str(), user.c_str(), password.c_str(), database.c_str(), port);
+            if (conn) conns_.push_back(conn);
+        }
+        if (conns_.empty()) {
+            throw std::runtime_error("光变曲线取数无法连接到 TDengine");
+        }
+    }
+    
+    ~LightCurveFetcher() {
+        for (TAOS* conn : conns_) taos_close(conn);
+    }
+    
+    LightCurveFetcher(const LightCurveFetcher&) = delete;
+    LightCurveFetcher& operator=(const LightCurveFetcher&) = delete;
+    
+    // 按 source_id 取光变曲线，汇总该源的全部子表；time_filter 为附加的 ts 条件（如 "ts >= '...' AND ts <= '...'"），
+    // 为空不限时间
+    bool fetch(const std::vector<int64_t>& source_ids, LightCurveSet& out, const std::string& time_filter = "") {
+        if (!resolve(source_ids)) return false;
+        std::vector<Part> parts;
+        for (size_t i = 0; i < source_ids.size(); ++i) {
+            auto it = subtables_.find(source_ids[i]);
+            if (it == subtables_.end()) continue;
+            for (int64_t healpix_id : it->second) parts.push_back({i, {source_ids[i], healpix_id}});
+        }
+        return fetchParts(source_ids, parts, out, time_filter);
+    }
+    
+    // 调用方已知子表时（如源位置索引的记录）直接按 (source_id, healpix_id) 取数；同一源的多个子表合并为一条光变曲线
+    bool fetch(const std::vector<Key>& keys, LightCurveSet& out, const std::string& time_filter = "") {
+        std::vector<int64_t> source_ids;
+        std::unordered_map<int64_t, size_t> slot_of;
+        std::vector<Part> parts;
+        for (const Key& key : keys) {
+            auto inserted = slot_of.emplace(key.source_id, source_ids.size());
+            if (inserted.second) source_ids.push_back(key.source_id);
+            parts.push_back({inserted.first->second, key});
+        }
+        return fetchParts(source_ids, parts, out, time_filter);
+    }
+    
+    // 有源位置索引时直接由索引记录得到每个源的全部子表，不再查询子表目录；索引中没有的源视为无观测
+    void useIndex(const SourcePositionIndex& index) {
+        subtables_.clear();
+        for (const SourceIndexRecord& record : index) subtables_[record.source_id].push_back(record.healpix_id);
+        indexed_ = true;
+    }
+    
+    const std::string& table() const { return table_; }
+    size_t connections() const { return conns_.size(); }
+    
+private:
+    struct Part {
+        size_t slot;  // 结果中源的位置
+        Key key;
+    };
+    
+    struct Series {
+        std::vector<int64_t> ts;
+        std::vector<double> ra, dec, mag;
+        
+        // 多个子表的观测按到达顺序拼接，乱序时按时间重排
+        void sortByTime() {
+            if (std::is_sorted(ts.begin(), ts.end())) return;
+            std::vector<uint32_t> order(ts.size());
+            for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<uint32_t>(i);
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return ts[a] < ts[b]; });
+            Series sorted;
+            for (uint32_t i : order) {
+                sorted.ts.push_back(ts[i]);
+                sorted.ra.push_back(ra[i]);
+                sorted.dec.push_back(dec[i]);
+                sorted.mag.push_back(mag[i]);
+            }
+            *this = std::move(sorted);
+        }
+    };
+    
+    static constexpr size_t RESOLVE_BATCH = 1000;
+    
+    std::string table_;
+    Options options_;
+    std::vector<TAOS*> conns_;
+    std::unordered_map<int64_t, std::vector<int64_t>> subtables_;  // source_id -> 全部 healpix_id，已查过的源才在表中
+    bool indexed_ = false;  // subtables_ 已由源位置索引完整填充
+    
+    // 与导入器 subTableName 的命名一致
+    std::string subTableName(const Key& key) const {
+        return table_ + "_" + std::to_string(key.healpix_id) + "_" + std::to_string(key.source_id);
+    }
+    
+    // 查出尚未缓存的源的全部子表标签（每批 RESOLVE_BATCH 个源一条语句）；已载入索引时无需查询
+    bool resolve(const std::vector<int64_t>& source_ids) {
+        if (indexed_) return true;
+        std::vector<int64_t> unknown;
+        for (int64_t id : source_ids) {
+            if (subtables_.emplace(id, std::vector<int64_t>()).second) unknown.push_back(id);
+        }
+        for (size_t begin = 0; begin < unknown.size(); begin += RESOLVE_BATCH) {
+            size_t end = std::min(unknown.size(), begin + RESOLVE_BATCH);
+            std::ostringstream oss;
+            oss << "SELECT DISTINCT healpix_id, source_id FROM " << table_ << " WHERE source_id IN (";
+            for (size_t i = begin; i < end; ++i) oss << (i > begin ? "," : "") << unknown[i];
+            oss << ")";
+            TAOS_RES* result = taos_query(conns_[0], oss.str().c_str());
+            if (taos_errno(result) != 0) {
+                std::cerr << "子表查询错误: " << taos_errstr(result) << std::endl;
+                taos_free_result(result);
+                for (size_t i = begin; i < unknown.size(); ++i) subtables_.erase(unknown[i]);
+                return false;
+            }
+            BlockResultReader reader(result);
+            int tag_col = reader.column("healpix_id", TSDB_DATA_TYPE_BIGINT);
+            int id_col = reader.column("source_id", TSDB_DATA_TYPE_BIGINT);
+            while (reader.next() > 0) {
+                const int64_t* tags = reader.span<int64_t>(tag_col);
+                const int64_t* ids = reader.span<int64_t>(id_col);
+                if (!tags || !ids) break;
+                for (int r = 0; r < reader.rows(); ++r) subtables_[ids[r]].push_back(tags[r]);
+            }
+            taos_free_result(result);
+        }
+        return true;
+    }
+    
+    bool fetchParts(const std::vector<int64_t>& source_ids, const std::vector<Part>& parts, LightCurveSet& out,
+                    const std::string& time_filter) {
+        size_t per_query = std::max<size_t>(1, options_.tables_per_query);
+        size_t batch_count = (parts.size() + per_query - 1) / per_query;
+        std::vector<Series> series(source_ids.size());
+        std::vector<std::mutex> locks(std::min<size_t>(source_ids.size(), 64) + 1);  // 同一源的子表可能落在不同批次
+        
+        std::atomic<size_t> cursor{0};
+        std::atomic<size_t> failed{0};
+        auto worker = [&](TAOS* conn) {
+            for (size_t b = cursor++; b < batch_count; b = cursor++) {
+                size_t begin = b * per_query;
+                size_t end = std::min(parts.size(), begin + per_query);
+                if (!fetchBatch(conn, parts, begin, end, time_filter, series, locks)) failed++;
+            }
+        };
+        size_t thread_count = std::min(conns_.size(), batch_count);
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < thread_count; ++t) threads.emplace_back(worker, conns_[t]);
+        if (thread_count > 0) worker(conns_[0]);
+        for (auto& thread : threads) thread.join();
+        
+        // 按输入顺序拼成连续列
+        out = LightCurveSet();
+        out.source_ids = source_ids;
+        out.offsets.reserve(source_ids.size() + 1);
+        size_t total = 0;
+        for (const auto& s : series) total += s.ts.size();
+        out.ts.reserve(total);
+        out.ra.reserve(total);
+        out.dec.reserve(total);
+        out.mag.reserve(total);
+        out.offsets.push_back(0);
+        std::vector<char> has_part(source_ids.size(), 0);
+        for (const Part& part : parts) has_part[part.slot] = 1;
+        for (size_t i = 0; i < source_ids.size(); ++i) {
+            Series& s = series[i];
+            s.sortByTime();
+            out.ts.insert(out.ts.end(), s.ts.begin(), s.ts.end());
+            out.ra.insert(out.ra.end(), s.ra.begin(), s.ra.end());
+            out.dec.insert(out.dec.end(), s.dec.begin(), s.dec.end());
+            out.mag.insert(out.mag.end(), s.mag.begin(), s.mag.end());
+            out.offsets.push_back(out.ts.size());
+            s = Series();
+            if (!has_part[i]) out.missing++;
+        }
+        return failed.load() == 0;
+    }
+    
+    bool fetchBatch(TAOS* conn, const std::vector<Part>& parts, size_t begin, size_t end,
+                    const std::string& time_filter, std::vector<Series>& series, std::vector<std::mutex>& locks) {
+        std::ostringstream oss;
+        for (size_t i = begin; i < end; ++i) {
+            if (i > begin) oss << " UNION ALL ";
+            oss << "SELECT ts, ra, dec, mag, " << parts[i].slot << " AS slot FROM " << subTableName(parts[i].key);
+            if (!time_filter.empty()) oss << " WHERE " << time_filter;
+        }
+        TAOS_RES* result = taos_query(conn, oss.str().c_str());
+        if (taos_errno(result) != 0) {
+            std::cerr << "光变曲线查询错误: " << taos_errstr(result) << std::endl;
+            taos_free_result(result);
+            return false;
+        }
+        BlockResultReader reader(result);
+        int slot_col = reader.column("slot", TSDB_DATA_TYPE_BIGINT);
+        int slot_col32 = slot_col < 0 ? reader.column("slot", TSDB_DATA_TYPE_INT) : -1;
+        while (reader.next() > 0) {
+            SkyColumns cols = SkyColumns::of(reader);
+            const int64_t* slots = reader.span<int64_t>(slot_col);
+            const int32_t* slots32 = reader.span<int32_t>(slot_col32);
+            if (!cols.hasPositions() || !cols.ts || !cols.mag || (!slots && !slots32)) break;
+            // 每个块的 slot 通常连续相同，按段整体追加
+            size_t r = 0;
+            while (r < cols.rows) {
+                int64_t slot = slots ? slots[r] : slots32[r];
+                size_t run = r + 1;
+                while (run < cols.rows && (slots ? slots[run] : slots32[run]) == slot) run++;
+                if (slot >= 0 && static_cast<size_t>(slot) < series.size()) {
+                    std::lock_guard<std::mutex> lock(locks[static_cast<size_t>(slot) % locks.size()]);
+                    Series& s = series[slot];
+                    s.ts.insert(s.ts.end(), cols.ts + r, cols.ts + run);
+                    s.ra.insert(s.ra.end(), cols.ra + r, cols.ra + run);
+                    s.dec.insert(s.dec.end(), cols.dec + r, cols.dec + run);
+                    s.mag.insert(s.mag.end(), cols.mag + r, cols.mag + run);
+                }
+                r = run;
+            }
+        }
+        taos_free_result(result);
+        return true;
+    }
+};
+
 class TDengineQueryTester {
 private:
     TAOS* conn;
+    std::string db_host, db_user, db_password;  // 交叉匹配时为并行取数另开连接
+    int db_port;
     std::string db_name;
     std::string table_name;
     int nside;
     std::unique_ptr<Healpix_Base> healpix_map;
+    HealpixPartition partition;
+    std::unique_ptr<PixelTileCache> tile_cache;  // 未启用时为空
+    SourcePositionIndex source_index;             // 未加载时锥形检索直接扫观测行
+    bool cone_light_curves = false;               // 两阶段检索是否取回锥内源的观测
+    size_t cone_rows_fetched = 0;
+    LightCurveFetcher::Options light_curve_options;
+    std::unique_ptr<LightCurveFetcher> light_curve_fetcher;  // 首次取光变曲线时建立连接池
     std::vector<TestData> test_coords_5k;
     std::vector<TestData> test_coords_100;
     
@@ -71,13 +666,28 @@ public:
                        int port = 6030,
                        const std::string& database = "test_db",
                        const std::string& table = "sensor_data",
-                       int nside_param = 64)
-        : conn(nullptr), db_name(database), table_name(table), nside(nside_param) {
+                       int nside_param = 64,
+                       const std::string& partition_map_path = "output/query_results/healpix_partition_map.csv")
+        : conn(nullptr), db_host(host), db_user(user), db_password(password), db_port(port),
+          db_name(database), table_name(table), nside(nside_param), partition(nside_param) {
         
         // 初始化 HealPix
         healpix_map = std::make_unique<Healpix_Base>(nside, NEST, SET_NSIDE);
         std::cout << "✅ HealPix 初始化成功，NSIDE=" << nside << std::endl;
         
+        // 读取导入器的分区表：细分区块按 (base << 32) + fine 编码查询
+        std::string partition_error;
+        if (partition.load(partition_map_path, partition_error)) {
+            if (partition.nsideBase() != nside) {
+                nside = partition.nsideBase();
+                healpix_map = std::make_unique<Healpix_Base>(nside, NEST, SET_NSIDE);
+            }
+            std::cout << "✅ 已加载分区表: " << partition.refinedCount() << " 个细分区块 (NSIDE="
+                     << nside << "/" << partition.nsideFine() << ")" << std::endl;
+        } else {
+            std::cout << "⚠️ " << partition_error << "，全部区块按 NSIDE=" << nside << " 查询" << std::endl;
+        }
+        
         // 初始化 TDengine
         taos_init();
         
@@ -176,77 +786,42 @@ public:
         return true;
     }
     
-    double nearestWithHealpix(double ra, double dec) {
+    // 精确 k 近邻源：逐圈扩展基础像素，直到下一圈不可能出现更近的源；出错返回空
+    std::vector<KnnSearch::Neighbor> knnWithHealpix(double ra, double dec, size_t k) {
         // 验证和裁剪坐标值到有效范围
         ra = fmod(ra, 360.0);
         if (ra < 0) ra += 360.0;
         dec = std::max(-90.0, std::min(90.0, dec));
         
-        // 使用真正的 HealPix 库，模仿Python的实现
-        pointing pt(deg2rad(90.0 - dec), deg2rad(ra));  // theta, phi in radians
-        
-        long center_id = healpix_map->ang2pix(pt);
-        
-        // 获取所有8个邻居像素 + 中心像素 (Python: hp.get_all_neighbours)
-        std::vector<long> healpix_ids;
-        healpix_ids.push_back(center_id);
-        
-        // 简化的邻居查找：基于HealPix分层结构的相邻像素
-        // 这是Python hp.get_all_neighbours的简化版本
-        for (int d_theta = -1; d_theta <= 1; ++d_theta) {
-            for (int d_phi = -1; d_phi <= 1; ++d_phi) {
-                if (d_theta == 0 && d_phi == 0) continue; // 跳过中心点
-                
-                // 计算邻近点的坐标
-                double theta = pt.theta + d_theta * M_PI / (2.0 * nside);
-                double phi = pt.phi + d_phi * 2.0 * M_PI / (4.0 * nside);
-                
-                // 确保在有效范围内
-                if (theta >= 0 && theta <= M_PI && phi >= 0 && phi < 2.0 * M_PI) {
-                    pointing neighbor_pt(theta, phi);
-                    long neighbor_id = healpix_map->ang2pix(neighbor_pt);
-                    if (neighbor_id >= 0 && neighbor_id < healpix_map->Npix()) {
-                        healpix_ids.push_back(neighbor_id);
-                    }
-                }
-            }
-        }
-        
-        // 构建 SQL 查询 - 查询超级表sensor_data而不是特定子表
-        std::ostringstream oss;
-        oss << "SELECT ra, dec FROM " << table_name << " WHERE healpix_id IN (";
-        for (size_t i = 0; i < healpix_ids.size(); ++i) {
-            if (i > 0) oss << ",";
-            oss << healpix_ids[i];
-        }
-        oss << ")";
-        
-        TAOS_RES* result = taos_query(conn, oss.str().c_str());
-        if (taos_errno(result) != 0) {
-            std::cerr << "查询错误: " << taos_errstr(result) << std::endl;
-            taos_free_result(result);
-            return -1.0;
-        }
-        
-        TAOS_ROW row;
-        double min_distance = std::numeric_limits<double>::max();
-        SkyCoord target(ra, dec);
-        bool found_any = false;
-        
-        while ((row = taos_fetch_row(result)) != nullptr) {
-            if (row[0] == nullptr || row[1] == nullptr) continue;
+        KnnSearch search(partition, ra, dec, k);
+        std::vector<long> ring;
+        while (search.nextRing(ring)) {
+            // 构建 SQL 查询 - 查询超级表sensor_data而不是特定子表，细分区块展开为其全部细分像素
+            std::ostringstream oss;
+            oss << "SELECT source_id, ra, dec FROM " << table_name << " WHERE " << search.ringPredicate(ring);
             
-            double query_ra = *static_cast<double*>(row[0]);
-            double query_dec = *static_cast<double*>(row[1]);
+            TAOS_RES* result = taos_query(conn, oss.str().c_str());
+            if (taos_errno(result) != 0) {
+                std::cerr << "查询错误: " << taos_errstr(result) << std::endl;
+                taos_free_result(result);
+                return {};
+            }
             
-            SkyCoord source(query_ra, query_dec);
-            double distance = target.separation(source);
-            min_distance = std::min(min_distance, distance);
-            found_any = true;
+            // 按块读取 source_id 与坐标列，每个源保留最近的观测
+            BlockResultReader reader(result);
+            while (reader.next() > 0) {
+                SkyColumns cols = SkyColumns::of(reader);
+                if (!cols.hasPositions() || cols.source_id == nullptr) break;
+                search.addCandidates(cols.source_id, cols.ra, cols.dec, cols.rows);
+            }
+            taos_free_result(result);
         }
-        
-        taos_free_result(result);
-        return found_any ? min_distance : -1.0;
+        return search.results();
+    }
+    
+    double nearestWithHealpix(double ra, double dec) {
+        auto neighbors = knnWithHealpix(ra, dec, 1);
+        return neighbors.empty() ? -1.0 : neighbors[0].distanceDeg();
     }
     
     int coneWithHealpix(double ra, double dec, double radius) {
@@ -259,23 +834,22 @@ public:
         pointing pt(deg2rad(90.0 - dec), deg2rad(ra));  // theta, phi in radians
         double radius_rad = deg2rad(radius);
         
-        std::vector<int> healpix_ids;
-        healpix_map->query_disc(pt, radius_rad, healpix_ids);
-        
-        if (healpix_ids.empty()) {
-            // 如果没有找到像素，可能半径太小，尝试包含中心像素
-            long center_id = healpix_map->ang2pix(pt);
-            healpix_ids.push_back(center_id);
+        if (source_index.isOpen()) {
+            std::vector<const SourceIndexRecord*> sources;
+            coneSources(ra, dec, radius, pt, radius_rad, sources);
+            if (cone_light_curves) cone_rows_fetched += fetchSourceObservations(sources);
+            // 观测跨像素的源有多条索引记录，按 source_id 去重计数
+            std::unordered_set<int64_t> distinct;
+            for (const SourceIndexRecord* record : sources) distinct.insert(record->source_id);
+            return static_cast<int>(distinct.size());
+        }
+        if (tile_cache) {
+            return coneWithTileCache(ra, dec, radius, pt, radius_rad);
         }
         
-        // 构建 SQL 查询 - 查询超级表sensor_data
+        // 构建 SQL 查询 - 查询超级表sensor_data；未细分区块用基础像素，细分区块内只取与圆盘相交的细分像素
         std::ostringstream oss;
-        oss << "SELECT ra, dec FROM " << table_name << " WHERE healpix_id IN (";
-        for (size_t i = 0; i < healpix_ids.size(); ++i) {
-            if (i > 0) oss << ",";
-            oss << healpix_ids[i];
-        }
-        oss << ")";
+        oss << "SELECT ra, dec FROM " << table_name << " WHERE " << partition.conePredicate(pt, radius_rad);
         
         TAOS_RES* result = taos_query(conn, oss.str().c_str());
         if (taos_errno(result) != 0) {
@@ -284,24 +858,205 @@ public:
             return 0;
         }
         
-        int count = 0;
-        TAOS_ROW row;
-        SkyCoord target(ra, dec);
+        // 按块读取坐标列，用点积与 cos(radius) 批量比较
+        ConeFilter filter(ra, dec, radius);
+        BlockResultReader reader(result);
+        std::vector<uint8_t> inside;
+        size_t count = 0;
+        while (reader.next() > 0) {
+            SkyColumns cols = SkyColumns::of(reader);
+            if (!cols.hasPositions()) break;
+            count += filter.mask(cols.ra, cols.dec, cols.rows, inside);
+        }
+        taos_free_result(result);
+        return static_cast<int>(count);
+    }
+    
+    bool enableSourceIndex(const std::string& path, bool light_curves) {
+        std::string error;
+        if (!source_index.open(path, error)) {
+            std::cerr << "❌ " << error << std::endl;
+            return false;
+        }
+        if (source_index.nsideBase() != partition.nsideBase() || source_index.nsideFine() != partition.nsideFine()) {
+            std::cerr << "❌ 源位置索引的 NSIDE (" << source_index.nsideBase() << "/" << source_index.nsideFine()
+                     << ") 与分区表不一致" << std::endl;
+            source_index.close();
+            return false;
+        }
+        cone_light_curves = light_curves;
+        std::cout << "📇 源位置索引: " << source_index.size() << " 个源，锥形检索"
+                 << (light_curves ? "先查索引再取光变曲线" : "只查索引") << std::endl;
+        return true;
+    }
+    
+    // 两阶段锥形检索第一阶段：在索引中按标签区间取子表记录，用各子表的平均位置筛选，不访问数据库
+    size_t coneSources(double ra, double dec, double radius, const pointing& pt, double radius_rad,
+                       std::vector<const SourceIndexRecord*>& sources) {
+        ConeFilter filter(ra, dec, radius);
+        std::vector<double> ras, decs;
+        std::vector<uint32_t> inside;
+        sources.clear();
+        for (const auto& range : partition.coneRanges(pt, radius_rad)) {
+            auto records = source_index.range(range.first, range.second);
+            size_t n = records.second - records.first;
+            if (n == 0) continue;
+            ras.resize(n);
+            decs.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                ras[i] = records.first[i].ra;
+                decs[i] = records.first[i].dec;
+            }
+            filter.select(ras.data(), decs.data(), n, inside);
+            for (uint32_t i : inside) sources.push_back(records.first + i);
+        }
+        return sources.size();
+    }
+    
+    // 第二阶段：只为锥内源取观测行（索引记录已带标签，直接查子表），返回取回的行数
+    size_t fetchSourceObservations(const std::vector<const SourceIndexRecord*>& sources) {
+        if (sources.empty()) return 0;
+        std::vector<LightCurveFetcher::Key> keys;
+        keys.reserve(sources.size());
+        for (const SourceIndexRecord* record : sources) keys.push_back({record->source_id, record->healpix_id});
+        LightCurveSet curves;
+        lightCurves().fetch(keys, curves);
+        return curves.rows();
+    }
+    
+    void setLightCurveOptions(const LightCurveFetcher::Options& options) {
+        light_curve_options = options;
+    }
+    
+    LightCurveFetcher& lightCurves() {
+        if (!light_curve_fetcher) {
+            light_curve_fetcher = std::make_unique<LightCurveFetcher>(db_host, db_user, db_password, db_port,
+                                                                     db_name, table_name, light_curve_options);
+            if (source_index.isOpen()) light_curve_fetcher->useIndex(source_index);
+        }
+        return *light_curve_fetcher;
+    }
+    
+    // 批量导出测试源的完整光变曲线，统计吞吐
+    bool runLightCurveExport(size_t max_sources) {
+        std::vector<int64_t> source_ids;
+        std::unordered_set<int64_t> seen;
+        for (const auto& data : test_coords_5k) {
+            if (source_ids.size() >= max_sources) break;
+            if (seen.insert(data.source_id).second) source_ids.push_back(data.source_id);
+        }
+        std::cout << "\n==== 📈 光变曲线批量取数：" << source_ids.size() << " 个源，每条语句 "
+                 << light_curve_options.tables_per_query << " 张子表 ====" << std::endl;
+        
+        LightCurveFetcher& fetcher = lightCurves();
+        
+        auto start_time = std::chrono::high_resolution_clock::now();
+        LightCurveSet curves;
+        bool ok = fetcher.fetch(source_ids, curves);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
         
-        while ((row = taos_fetch_row(result)) != nullptr) {
-            if (row[0] == nullptr || row[1] == nullptr) continue;
+        size_t empty = 0;
+        for (size_t i = 0; i < curves.sources(); ++i) {
+            if (curves.count(i) == 0) empty++;
+        }
+        std::cout << "✅ 取回 " << curves.rows() << " 行，" << curves.sources() << " 个源（库中无子表 "
+                 << curves.missing << " 个，无观测 " << empty << " 个），" << fetcher.connections()
+                 << " 条连接，耗时 " << seconds << " 秒" << std::endl;
+        if (seconds > 0) {
+            std::cout << "📊 吞吐: " << static_cast<size_t>(curves.rows() / seconds) << " 行/秒，"
+                     << (curves.bytes() / (1024.0 * 1024.0) / seconds) << " MB/秒" << std::endl;
+        }
+        return ok;
+    }
+    
+    void enableTileCache(size_t max_mb, size_t max_tiles) {
+        tile_cache = std::make_unique<PixelTileCache>(max_mb * 1024 * 1024, max_tiles);
+        std::cout << "🗃️ 像素分块缓存: " << max_mb << " MB，最多 " << max_tiles << " 块" << std::endl;
+    }
+    
+    // 锥形检索的缓存路径：已缓存的像素直接取块，其余像素合并成一条查询，结果按 healpix_id 切块写回缓存
+    int coneWithTileCache(double ra, double dec, double radius, const pointing& pt, double radius_rad) {
+        const uint32_t columns = PixelTileCache::RA | PixelTileCache::DEC;
+        const std::string window;  // 锥形检索不限时间
+        std::vector<PixelTileCache::TilePtr> tiles;
+        std::vector<HealpixPartition::TagRange> missing;
+        for (const auto& range : partition.coneRanges(pt, radius_rad)) {
+            for (int64_t tag = range.first; tag < range.second; ++tag) {
+                PixelTileCache::TilePtr tile = tile_cache->get(tag, window, columns);
+                if (tile) {
+                    tiles.push_back(std::move(tile));
+                } else {
+                    missing.push_back({tag, tag + 1});
+                }
+            }
+        }
+        
+        if (!missing.empty()) {
+            std::vector<int64_t> missing_tags;
+            for (const auto& range : missing) missing_tags.push_back(range.first);
             
-            double query_ra = *static_cast<double*>(row[0]);
-            double query_dec = *static_cast<double*>(row[1]);
+            std::ostringstream oss;
+            oss << "SELECT healpix_id, ra, dec FROM " << table_name << " WHERE "
+                << HealpixPartition::predicateOf(missing);
+            TAOS_RES* result = taos_query(conn, oss.str().c_str());
+            if (taos_errno(result) != 0) {
+                std::cerr << "锥形查询错误: " << taos_errstr(result) << std::endl;
+                taos_free_result(result);
+                return 0;
+            }
+            std::unordered_map<int64_t, std::shared_ptr<PixelTileCache::Tile>> fetched;
+            BlockResultReader reader(result);
+            int tag_col = reader.column("healpix_id", TSDB_DATA_TYPE_BIGINT);
+            while (reader.next() > 0) {
+                SkyColumns cols = SkyColumns::of(reader);
+                const int64_t* tags = reader.span<int64_t>(tag_col);
+                if (!cols.hasPositions() || !tags) break;
+                for (size_t r = 0; r < cols.rows; ++r) {
+                    auto& tile = fetched[tags[r]];
+                    if (!tile) tile = std::make_shared<PixelTileCache::Tile>();
+                    tile->ra.push_back(cols.ra[r]);
+                    tile->dec.push_back(cols.dec[r]);
+                }
+            }
+            taos_free_result(result);
             
-            SkyCoord source(query_ra, query_dec);
-            if (target.separation(source) < radius) {
-                count++;
+            // 没有数据的像素也缓存为空块，避免重复查询
+            for (int64_t tag : missing_tags) {
+                auto it = fetched.find(tag);
+                std::shared_ptr<PixelTileCache::Tile> tile =
+                    it != fetched.end() ? it->second : std::make_shared<PixelTileCache::Tile>();
+                tile->ra.shrink_to_fit();
+                tile->dec.shrink_to_fit();
+                tile_cache->put(tag, window, columns, tile);
+                tiles.push_back(tile);
             }
         }
         
-        taos_free_result(result);
-        return count;
+        ConeFilter filter(ra, dec, radius);
+        std::vector<uint8_t> inside;
+        size_t count = 0;
+        for (const auto& tile : tiles) {
+            count += filter.mask(tile->ra.data(), tile->dec.data(), tile->ra.size(), inside);
+        }
+        return static_cast<int>(count);
+    }
+    
+    // 外部星表批量交叉匹配
+    bool runCrossMatch(const std::string& catalog, const CatalogCrossMatcher::Options& options,
+                       const std::string& output, CrossMatchSink::Format format) {
+        std::cout << "\n==== 🔗 星表交叉匹配：" << catalog << "，半径 " << options.radius_arcsec << " 角秒，"
+                 << (options.all_within ? "输出半径内全部源" : "只输出最近源") << " ====" << std::endl;
+        std::vector<CrossMatchTarget> targets;
+        if (!CatalogCrossMatcher::loadCatalog(catalog, targets)) return false;
+        CrossMatchSink sink(output, format);
+        if (!sink.ok()) {
+            std::cerr << "❌ 无法写入匹配结果: " << output << std::endl;
+            return false;
+        }
+        CatalogCrossMatcher matcher(db_host, db_user, db_password, db_port, db_name, table_name, partition, options);
+        bool ok = matcher.run(targets, sink);
+        std::cout << "📄 匹配结果: " << output << std::endl;
+        return ok;
     }
     
     void runNearestNeighborTest() {
@@ -357,6 +1112,19 @@ public:
             std::cout << test_coords_100.size() << "个锥形检索（healpix，半径" << radius 
                      << "度）总耗时：" << (duration.count() / 1000.0) << "秒，总找到：" 
                      << total_count << "个源" << std::endl;
+            if (source_index.isOpen() && cone_light_curves) {
+                std::cout << "📈 取回锥内源的观测: " << cone_rows_fetched << " 行" << std::endl;
+                cone_rows_fetched = 0;
+            }
+        }
+        
+        if (tile_cache) {
+            PixelTileCache::Stats stats = tile_cache->stats();
+            std::cout << "🗃️ 像素缓存: 命中 " << stats.hits << "，未命中 " << stats.misses << "，命中率 "
+                     << std::fixed << std::setprecision(1) << stats.hitRate() * 100 << "%，淘汰 "
+                     << stats.evictions << "，当前 " << stats.tiles << " 块 / "
+                     << (stats.bytes / (1024.0 * 1024.0)) << " MB" << std::endl;
+            std::cout.unsetf(std::ios::fixed);
         }
     }
     
@@ -395,10 +1163,8 @@ public:
                 
                 TAOS_RES* result = taos_query(conn, sql.str().c_str());
                 if (taos_errno(result) == 0) {
-                    TAOS_ROW row = taos_fetch_row(result);
-                    if (row) {
-                        // 查询成功
-                    }
+                    BlockResultReader reader(result);
+                    reader.next();  // COUNT(*) 只有一行
                 }
                 taos_free_result(result);
                 
@@ -471,12 +1237,80 @@ public:
     }
 };
 
-int main() {
+int main(int argc, char* argv[]) {
+    // 交叉匹配模式: --crossmatch <星表CSV> [--radius <角秒>] [--all] [--output <文件>] [--format csv|bin] [--connections <值>]
+    // 光变曲线批量取数: --light_curve_export <源数> [--tables_per_query <值>] [--connections <值>]
+    std::string crossmatch_catalog;
+    std::string crossmatch_output;
+    CrossMatchSink::Format crossmatch_format = CrossMatchSink::Format::CSV;
+    CatalogCrossMatcher::Options crossmatch_options;
+    size_t cache_mb = 0;          // 0 表示不启用像素分块缓存
+    size_t cache_tiles = 10000;   // 对应 QUERY_CONFIG['spatial_cache_size']
+    std::string source_index_path;  // 为空时锥形检索不走源位置索引
+    bool light_curves = false;
+    size_t light_curve_export = 0;  // 大于 0 时只做光变曲线批量取数
+    LightCurveFetcher::Options light_curve_options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--crossmatch" && i + 1 < argc) {
+            crossmatch_catalog = argv[++i];
+        } else if (arg == "--radius" && i + 1 < argc) {
+            crossmatch_options.radius_arcsec = std::atof(argv[++i]);
+        } else if (arg == "--all") {
+            crossmatch_options.all_within = true;
+        } else if (arg == "--output" && i + 1 < argc) {
+            crossmatch_output = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            crossmatch_format = (format == "bin" || format == "binary") ? CrossMatchSink::Format::BINARY
+                                                                        : CrossMatchSink::Format::CSV;
+        } else if (arg == "--connections" && i + 1 < argc) {
+            crossmatch_options.connections = std::atoi(argv[++i]);
+            light_curve_options.connections = crossmatch_options.connections;
+        } else if (arg == "--cache_mb" && i + 1 < argc) {
+            cache_mb = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--cache_tiles" && i + 1 < argc) {
+            cache_tiles = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--source_index" && i + 1 < argc) {
+            source_index_path = argv[++i];
+        } else if (arg == "--light_curves") {
+            light_curves = true;
+        } else if (arg == "--light_curve_export" && i + 1 < argc) {
+            light_curve_export = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--tables_per_query" && i + 1 < argc) {
+            light_curve_options.tables_per_query = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "未知参数: " << arg << std::endl;
+            std::cerr << "用法: " << argv[0] << " [--crossmatch <星表CSV> [--radius <角秒>] [--all] "
+                     << "[--output <文件>] [--format csv|bin] [--connections <值>]] "
+                     << "[--cache_mb <值>] [--cache_tiles <值>] "
+                     << "[--source_index <索引文件> [--light_curves]] "
+                     << "[--light_curve_export <源数> [--tables_per_query <值>]]" << std::endl;
+            return 1;
+        }
+    }
+    
     try {
         std::cout << "🌟 TDengine HealPix 同步查询性能测试器 (原始版本)" << std::endl;
         std::cout << "============================================================" << std::endl;
         
         TDengineQueryTester tester;
+        tester.setLightCurveOptions(light_curve_options);
+        if (cache_mb > 0) {
+            tester.enableTileCache(cache_mb, cache_tiles);
+        }
+        if (!source_index_path.empty() && !tester.enableSourceIndex(source_index_path, light_curves)) {
+            return 1;
+        }
+        
+        if (!crossmatch_catalog.empty()) {
+            if (crossmatch_output.empty()) {
+                crossmatch_output = std::string("output/query_results/crossmatch.") +
+                    (crossmatch_format == CrossMatchSink::Format::BINARY ? "bin" : "csv");
+            }
+            return tester.runCrossMatch(crossmatch_catalog, crossmatch_options,
+                                        crossmatch_output, crossmatch_format) ? 0 : 1;
+        }
         
         // 加载测试数据
         if (!tester.loadTestData("../data/test_data_100M.csv")) {
@@ -484,6 +1318,10 @@ int main() {
             return 1;
         }
         
+        if (light_curve_export > 0) {
+            return tester.runLightCurveExport(light_curve_export) ? 0 : 1;
+        }
+        
         // 运行性能测试
         tester.runNearestNeighborTest();
         tester.runConeSearchTest();
@@ -13,9 +13,26 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
 #include <atomic>
 #include <future>
+#include <functional>
+#include <limits>
+#include <unordered_set>
+#include <unordered_map>
+#include <deque>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cerrno>
+#include <random>
+#include <csignal>
+#include <ctime>
+#include <cstdio>
+
+// POSIX 文件接口（检查点 fsync）
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 // TDengine 头文件
 #include <taos.h>
@@ -24,6 +41,9 @@
 #include <healpix_cxx/healpix_base.h>
 #include <healpix_cxx/pointing.h>
 
+// 源位置索引格式（与查询工具共用）
+#include "healpix_common.h"
+
 const double PI = 3.14159265358979323846;
 
 // 度数转弧度函数
@@ -39,8 +59,40 @@ struct AstronomicalRecord {
     double mag;
     double jd_tcb;
     long healpix_id;
+    int64_t ts_ms = 0;   // 由 timestamp 解析出的毫秒时间戳，用于排序与去重
 };
 
+// 解析 "YYYY-MM-DD HH:MM:SS[.fff]" 为毫秒时间戳（按本地时区，与 TDengine 客户端解析字符串时间的方式一致）
+// mktime 开销较大，按线程缓存最近一次 "YYYY-MM-DD HH" 前缀对应的整点时间；格式不符返回 INT64_MIN
+inline int64_t parseTimestampMs(const std::string& text) {
+    thread_local char cached_prefix[14] = {0};
+    thread_local int64_t cached_hour_ms = 0;
+    
+    int year, month, day, hour, minute, second;
+    char fraction[8] = {0};
+    int fields = std::sscanf(text.c_str(), "%d-%d-%d %d:%d:%d.%7[0-9]",
+                             &year, &month, &day, &hour, &minute, &second, fraction);
+    if (fields < 6 || text.size() < 13) return std::numeric_limits<int64_t>::min();
+    
+    if (std::memcmp(cached_prefix, text.data(), 13) != 0) {
+        std::tm tm_value{};
+        tm_value.tm_year = year - 1900;
+        tm_value.tm_mon = month - 1;
+        tm_value.tm_mday = day;
+        tm_value.tm_hour = hour;
+        tm_value.tm_isdst = -1;
+        cached_hour_ms = static_cast<int64_t>(std::mktime(&tm_value)) * 1000;
+        std::memcpy(cached_prefix, text.data(), 13);
+    }
+    
+    // 只取前三位小数，不足三位补零
+    int millis = 0;
+    for (int i = 0; i < 3; ++i) {
+        millis = millis * 10 + (fraction[i] ? fraction[i] - '0' : 0);
+    }
+    return cached_hour_ms + (minute * 60 + second) * 1000LL + millis;
+}
+
 // 进度条显示类
 class ProgressBar {
 private:
@@ -51,7 +103,7 @@ public:
     ProgressBar(int width = 50) : bar_width_(width) {}
     
     void displayProgress(int current, int total, int success, int error, double rate, 
-                        int elapsed_seconds) {
+                        int elapsed_seconds, int eta_seconds = -1) {
         std::lock_guard<std::mutex> lock(print_mutex_);
         
         // 计算进度百分比
@@ -82,6 +134,10 @@ public:
         int minutes = elapsed_seconds / 60;
         int seconds = elapsed_seconds % 60;
         std::cout << "⏱️" << minutes << ":" << std::setfill('0') << std::setw(2) << seconds;
+        if (eta_seconds >= 0 && current < total) {
+            std::cout << " ⏳" << eta_seconds / 60 << ":" << std::setw(2) << eta_seconds % 60;
+        }
+        std::cout << std::setfill(' ');
         
         std::cout << std::flush;
         
@@ -97,235 +153,2054 @@ public:
     }
 };
 
+// 当前线程的工作线程编号：工作线程启动时绑定，其余线程为 -1（计入公共槽位）
+inline thread_local int g_worker_slot = -1;
+
+inline void bindWorkerSlot(int worker_id) {
+    g_worker_slot = worker_id;
+}
+
 // 线程安全的统计类
+// 高频计数按工作线程分片（每片独占一条缓存行），读取时求和；低频计数直接使用原子量
 class ThreadSafeStats {
 private:
-    std::mutex mutex_;
-    std::atomic<int> total_success_{0};
-    std::atomic<int> total_error_{0};
-    std::atomic<int> processed_groups_{0};
+    static constexpr int SHARDS = 65;  // 最多 64 个工作线程 + 1 个公共分片
+    
+    struct alignas(64) Shard {
+        std::atomic<int> success{0};
+        std::atomic<int> error{0};
+        std::atomic<int> groups{0};
+        std::atomic<long> in_flight{0};
+    };
+    
+    std::array<Shard, SHARDS> shards_;
+    std::atomic<int> retries_{0};
+    std::atomic<int> dead_letter_rows_{0};
+    
+    Shard& local() {
+        int slot = g_worker_slot;
+        return shards_[(slot >= 0 && slot < SHARDS - 1) ? slot : SHARDS - 1];
+    }
+    
+    template <typename Field>
+    long sum(Field field) const {
+        long total = 0;
+        for (const auto& shard : shards_) total += (shard.*field).load(std::memory_order_relaxed);
+        return total;
+    }
 
 public:
-    void addSuccess(int count) { total_success_ += count; }
-    void addError(int count) { total_error_ += count; }
-    void incrementGroup() { processed_groups_++; }
+    void addSuccess(int count) { local().success.fetch_add(count, std::memory_order_relaxed); }
+    void addError(int count) { local().error.fetch_add(count, std::memory_order_relaxed); }
+    void incrementGroup(int count = 1) { local().groups.fetch_add(count, std::memory_order_relaxed); }
+    void addInFlight(long rows) { local().in_flight.fetch_add(rows, std::memory_order_relaxed); }
+    void addRetry() { retries_++; }
+    void addDeadLetter(int count) { dead_letter_rows_ += count; }
     
-    int getSuccess() const { return total_success_; }
-    int getError() const { return total_error_; }
-    int getProcessedGroups() const { return processed_groups_; }
+    int getSuccess() const { return static_cast<int>(sum(&Shard::success)); }
+    int getError() const { return static_cast<int>(sum(&Shard::error)); }
+    int getProcessedGroups() const { return static_cast<int>(sum(&Shard::groups)); }
+    long getInFlight() const { return sum(&Shard::in_flight); }
+    int getRetries() const { return retries_; }
+    int getDeadLetterRows() const { return dead_letter_rows_; }
 };
 
-// TDengine 连接池
-class TDengineConnectionPool {
+// 进度上报线程：按固定间隔采样分片计数，终端下渲染进度条，可同时向文件追加 JSON Lines；
+// 工作线程只做原子累加，不做任何输出
+class ProgressReporter {
 private:
-    std::queue<TAOS*> connections_;
+    using Clock = std::chrono::steady_clock;
+    
+    ThreadSafeStats& stats_;
+    ProgressBar& bar_;
+    int total_tasks_;
+    long total_rows_;
+    std::chrono::milliseconds interval_;
+    std::ofstream json_;
+    bool tty_;
+    
+    Clock::time_point start_;
+    Clock::time_point last_time_;
+    long last_rows_ = 0;
+    
+    std::thread thread_;
     std::mutex mutex_;
-    std::condition_variable cv_;
-    std::string host_, user_, password_, db_name_;
-    int port_;
-    int pool_size_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+    bool finished_ = false;
+    
+    void sample(bool final) {
+        auto now = Clock::now();
+        double elapsed_s = std::chrono::duration<double>(now - start_).count();
+        double window_s = std::chrono::duration<double>(now - last_time_).count();
+        long rows = stats_.getSuccess();
+        long errors = stats_.getError();
+        int done = final ? total_tasks_ : stats_.getProcessedGroups();
+        double recent_rate = window_s > 0.0 ? (rows - last_rows_) / window_s : 0.0;
+        double avg_rate = elapsed_s > 0.0 ? rows / elapsed_s : 0.0;
+        double eta_rate = recent_rate > 0.0 ? recent_rate : avg_rate;
+        long remaining = std::max(0L, total_rows_ - rows - errors);
+        int eta_s = (eta_rate > 0.0 && !final) ? static_cast<int>(remaining / eta_rate) : 0;
+        last_rows_ = rows;
+        last_time_ = now;
+        
+        if (tty_) {
+            bar_.displayProgress(done, total_tasks_, static_cast<int>(rows), static_cast<int>(errors),
+                                 final ? avg_rate : recent_rate, static_cast<int>(elapsed_s), eta_s);
+        }
+        if (json_.is_open()) {
+            auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            json_ << std::fixed << std::setprecision(1)
+                  << "{\"ts\": " << wall_ms
+                  << ", \"elapsed_s\": " << elapsed_s
+                  << ", \"tasks_done\": " << done
+                  << ", \"tasks_total\": " << total_tasks_
+                  << ", \"rows\": " << rows
+                  << ", \"rows_total\": " << total_rows_
+                  << ", \"errors\": " << errors
+                  << ", \"rows_per_sec\": " << recent_rate
+                  << ", \"avg_rows_per_sec\": " << avg_rate
+                  << ", \"in_flight_rows\": " << stats_.getInFlight()
+                  << ", \"eta_s\": " << eta_s
+                  << ", \"final\": " << (final ? "true" : "false") << "}\n" << std::flush;
+        }
+    }
+    
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_cv_.wait_for(lock, interval_, [this] { return stop_; })) {
+            lock.unlock();
+            sample(false);
+            lock.lock();
+        }
+    }
 
 public:
-    TDengineConnectionPool(const std::string& host, const std::string& user, 
-                          const std::string& password, const std::string& db_name,
-                          int port, int pool_size = 8) 
-        : host_(host), user_(user), password_(password), db_name_(db_name), 
-          port_(port), pool_size_(pool_size) {
-        
-        // 初始化连接池
-        for (int i = 0; i < pool_size_; ++i) {
-            TAOS* conn = taos_connect(host_.c_str(), user_.c_str(), password_.c_str(), nullptr, port_);
-            if (conn) {
-                // 使用数据库
-                std::string use_db_sql = "USE " + db_name_;
-                TAOS_RES* result = taos_query(conn, use_db_sql.c_str());
-                if (taos_errno(result) == 0) {
-                    connections_.push(conn);
-                } else {
-                    taos_close(conn);
-                }
-                taos_free_result(result);
+    ProgressReporter(ThreadSafeStats& stats, ProgressBar& bar, int total_tasks, long total_rows,
+                     double interval_s, const std::string& json_path)
+        : stats_(stats), bar_(bar), total_tasks_(total_tasks), total_rows_(total_rows),
+          interval_(std::max<long>(50, static_cast<long>(interval_s * 1000))),
+          tty_(isatty(STDOUT_FILENO) != 0), start_(Clock::now()), last_time_(start_) {
+        if (!json_path.empty()) {
+            std::filesystem::path path(json_path);
+            if (path.has_parent_path()) {
+                std::filesystem::create_directories(path.parent_path());
+            }
+            json_.open(json_path, std::ios::app);
+            if (!json_.is_open()) {
+                std::cerr << "⚠️ 无法写入进度文件: " << json_path << std::endl;
             }
         }
-        
-        std::cout << "✅ 连接池初始化完成，连接数: " << connections_.size() << std::endl;
+        thread_ = std::thread(&ProgressReporter::run, this);
+    }
+    
+    // 停止采样并输出最终一行
+    void finish() {
+        if (finished_) return;
+        finished_ = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        stop_cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+        sample(true);
+    }
+    
+    ~ProgressReporter() {
+        finish();
     }
+};
 
-    ~TDengineConnectionPool() {
-        while (!connections_.empty()) {
-            taos_close(connections_.front());
-            connections_.pop();
+// 自适应批大小与并发控制器
+// 按窗口统计每批延迟与吞吐，批大小受 SQL 长度上限约束，活跃线程数按 AIMD 调整，
+// 找到吞吐拐点后停止探测；负载或行宽变化导致吞吐明显下降时重新探测
+class AdaptiveIngestController {
+private:
+    enum class Phase { PROBE_BATCH, PROBE_WORKERS, STEADY };
+
+    bool enabled_;
+    int max_workers_;
+    size_t max_sql_bytes_;
+    std::atomic<int> batch_size_;
+    std::atomic<int> active_workers_;
+    std::atomic<bool> finished_{false};
+
+    std::mutex mutex_;
+    std::condition_variable slot_cv_;
+    std::function<void(const std::string&)> logger_;
+    std::vector<std::string> decisions_;
+
+    // 当前窗口累计值
+    Phase phase_ = Phase::PROBE_BATCH;
+    std::chrono::high_resolution_clock::time_point window_start_;
+    long window_rows_ = 0;
+    int window_batches_ = 0;
+    double window_latency_ms_ = 0.0;
+
+    // 历史基线
+    double last_rate_ = 0.0;
+    double knee_rate_ = 0.0;
+    double baseline_latency_ms_ = 0.0;
+    double avg_row_bytes_ = 0.0;
+    int last_step_batch_ = 0;     // 上一步调整前的取值，用于回退
+    int last_step_workers_ = 0;
+    int slow_windows_ = 0;
+
+    static constexpr double KNEE_GAIN = 0.05;         // 增益低于 5% 视为到达拐点
+    static constexpr double DEGRADE_RATIO = 0.70;     // 稳态吞吐跌破拐点的 70% 重新探测
+    static constexpr double LATENCY_CEILING = 4.0;    // 批延迟超过基线 4 倍即乘性退让
+    static constexpr int MIN_BATCH = 50;
+    static constexpr double WINDOW_SECONDS = 2.0;
+
+    int sqlRowCap() const {
+        if (avg_row_bytes_ <= 0.0) return std::numeric_limits<int>::max();
+        // 预留 10% 给语句头和表名
+        return std::max(MIN_BATCH, static_cast<int>(max_sql_bytes_ * 0.9 / avg_row_bytes_));
+    }
+
+    void log(const std::string& message) {
+        decisions_.push_back(message);
+        if (logger_) logger_("🎛️ " + message);
+    }
+
+    void setBatch(int value, const std::string& reason) {
+        value = std::max(MIN_BATCH, std::min(value, sqlRowCap()));
+        if (value == batch_size_) return;
+        log("批大小 " + std::to_string(batch_size_.load()) + " -> " + std::to_string(value) + " (" + reason + ")");
+        batch_size_ = value;
+    }
+
+    void setWorkers(int value, const std::string& reason) {
+        value = std::max(1, std::min(value, max_workers_));
+        if (value == active_workers_) return;
+        log("活跃线程 " + std::to_string(active_workers_.load()) + " -> " + std::to_string(value) + " (" + reason + ")");
+        active_workers_ = value;
+        slot_cv_.notify_all();
+    }
+
+    void evaluateWindow(double elapsed_s) {
+        double rate = window_rows_ / elapsed_s;
+        double latency = window_latency_ms_ / window_batches_;
+        if (baseline_latency_ms_ <= 0.0) baseline_latency_ms_ = latency;
+
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(0) << rate << " 行/秒, 批延迟 "
+            << std::setprecision(1) << latency << " ms";
+        std::string metrics = oss.str();
+
+        // 延迟失控：乘性减少并发
+        if (latency > baseline_latency_ms_ * LATENCY_CEILING && active_workers_ > 1) {
+            setWorkers(active_workers_ * 3 / 4, "延迟超过基线 " + std::to_string(static_cast<int>(LATENCY_CEILING)) + " 倍, " + metrics);
+            baseline_latency_ms_ = latency;
+            phase_ = Phase::STEADY;
+            knee_rate_ = rate;
+            last_rate_ = rate;
+            return;
+        }
+
+        switch (phase_) {
+            case Phase::PROBE_BATCH:
+                if (last_rate_ > 0.0 && rate < last_rate_ * (1.0 + KNEE_GAIN)) {
+                    if (rate < last_rate_) {
+                        setBatch(last_step_batch_, "批大小拐点, 回退, " + metrics);
+                        rate = last_rate_;
+                    } else {
+                        log("批大小拐点 " + std::to_string(batch_size_.load()) + ", " + metrics);
+                    }
+                    phase_ = Phase::PROBE_WORKERS;
+                    last_step_workers_ = active_workers_;
+                    setWorkers(active_workers_ + 1, "加性探测, " + metrics);
+                } else if (batch_size_ * 3 / 2 > sqlRowCap()) {
+                    setBatch(sqlRowCap(), "达到 SQL 长度上限, " + metrics);
+                    phase_ = Phase::PROBE_WORKERS;
+                    last_step_workers_ = active_workers_;
+                    setWorkers(active_workers_ + 1, "加性探测, " + metrics);
+                } else {
+                    last_step_batch_ = batch_size_;
+                    setBatch(batch_size_ * 3 / 2, "探测批大小, " + metrics);
+                }
+                break;
+
+            case Phase::PROBE_WORKERS:
+                if (rate < last_rate_ * (1.0 + KNEE_GAIN) || active_workers_ >= max_workers_) {
+                    if (rate < last_rate_) {
+                        setWorkers(last_step_workers_, "并发拐点, 回退, " + metrics);
+                        rate = last_rate_;
+                    } else {
+                        log("并发拐点 " + std::to_string(active_workers_.load()) + " 线程, " + metrics);
+                    }
+                    phase_ = Phase::STEADY;
+                    knee_rate_ = rate;
+                } else {
+                    last_step_workers_ = active_workers_;
+                    setWorkers(active_workers_ + 1, "加性探测, " + metrics);
+                }
+                break;
+
+            case Phase::STEADY:
+                // 行宽变化后重新约束批大小
+                if (batch_size_ > sqlRowCap()) setBatch(sqlRowCap(), "行宽变化, SQL 长度上限");
+                if (rate < knee_rate_ * DEGRADE_RATIO) {
+                    if (++slow_windows_ >= 2) {
+                        setWorkers(std::max(1, active_workers_ / 2), "吞吐跌破拐点 " +
+                                   std::to_string(static_cast<int>(DEGRADE_RATIO * 100)) + "%, 乘性退让并重新探测, " + metrics);
+                        phase_ = Phase::PROBE_BATCH;
+                        baseline_latency_ms_ = 0.0;
+                        slow_windows_ = 0;
+                        rate = 0.0;
+                    }
+                } else {
+                    slow_windows_ = 0;
+                }
+                break;
         }
+        last_rate_ = rate;
+    }
+
+public:
+    AdaptiveIngestController(bool enabled, int initial_batch, int max_workers, size_t max_sql_bytes)
+        : enabled_(enabled), max_workers_(max_workers), max_sql_bytes_(max_sql_bytes),
+          batch_size_(initial_batch),
+          active_workers_(enabled ? std::max(1, max_workers / 2) : max_workers) {
+        window_start_ = std::chrono::high_resolution_clock::now();
+        last_step_batch_ = initial_batch;
+        last_step_workers_ = active_workers_;
     }
 
-    TAOS* getConnection() {
+    void setLogger(std::function<void(const std::string&)> logger) { logger_ = std::move(logger); }
+
+    bool enabled() const { return enabled_; }
+    int batchSize() const { return batch_size_; }
+    int activeWorkers() const { return active_workers_; }
+
+    // 编号不小于活跃线程数的工作线程在此等待
+    void waitForSlot(int worker_id) {
+        if (!enabled_ || worker_id < active_workers_) return;
         std::unique_lock<std::mutex> lock(mutex_);
-        cv_.wait(lock, [this] { return !connections_.empty(); });
-        
-        TAOS* conn = connections_.front();
-        connections_.pop();
-        return conn;
+        slot_cv_.wait(lock, [this, worker_id] { return worker_id < active_workers_ || finished_; });
     }
 
-    void returnConnection(TAOS* conn) {
+    // 任务取尽后释放所有等待中的线程
+    void finish() {
         std::lock_guard<std::mutex> lock(mutex_);
-        connections_.push(conn);
-        cv_.notify_one();
+        finished_ = true;
+        slot_cv_.notify_all();
     }
 
-    size_t size() const {
-        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(mutex_));
-        return connections_.size();
+    void recordBatch(int rows, size_t sql_bytes, double latency_ms, bool ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (rows > 0) {
+            double row_bytes = static_cast<double>(sql_bytes) / rows;
+            avg_row_bytes_ = (avg_row_bytes_ <= 0.0) ? row_bytes : avg_row_bytes_ * 0.9 + row_bytes * 0.1;
+        }
+        if (!enabled_) {
+            if (batch_size_ > sqlRowCap()) setBatch(sqlRowCap(), "SQL 长度上限");
+            return;
+        }
+
+        if (ok) window_rows_ += rows;
+        window_batches_++;
+        window_latency_ms_ += latency_ms;
+
+        auto now = std::chrono::high_resolution_clock::now();
+        double elapsed_s = std::chrono::duration<double>(now - window_start_).count();
+        if (elapsed_s < WINDOW_SECONDS || window_batches_ < 2 * active_workers_) return;
+
+        evaluateWindow(elapsed_s);
+        window_start_ = now;
+        window_rows_ = 0;
+        window_batches_ = 0;
+        window_latency_ms_ = 0.0;
     }
-};
 
-// 工作任务结构
-struct ImportTask {
-    long healpix_id;
-    int source_id;
-    std::vector<const AstronomicalRecord*> records;
-    
-    ImportTask(long hid, int sid, const std::vector<const AstronomicalRecord*>& recs)
-        : healpix_id(hid), source_id(sid), records(recs) {}
+    std::vector<std::string> decisions() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return decisions_;
+    }
 };
 
-class TDengineHealpixImporter {
+// 断点续传日志
+// 追加写入已完成任务的 (healpix_id, source_id, 子批序号)，按条数或时间间隔 fsync；
+// 文件头记录输入与分区参数的指纹，参数不一致的日志不会被续用
+class CheckpointJournal {
 private:
-    TAOS* conn;
-    std::string db_name;
-    std::string table_name;
-    int nside_base;
-    int nside_fine;
-    int count_threshold;
-    int batch_size;
-    int thread_count;
-    std::unique_ptr<Healpix_Base> healpix_base;
-    std::unique_ptr<Healpix_Base> healpix_fine;
-    std::unique_ptr<TDengineConnectionPool> conn_pool;
+#pragma pack(push, 1)
+    struct Entry {
+        int64_t healpix_id;
+        int32_t source_id;
+        uint32_t chunk;
+    };
+#pragma pack(pop)
+    static constexpr char MAGIC[8] = {'H', 'P', 'C', 'K', 'P', 'T', '0', '1'};
+    static constexpr size_t SYNC_EVERY = 1024;
 
-public:
-    TDengineHealpixImporter(const std::string& database,
-                           const std::string& host = "localhost",
-                           const std::string& user = "root",
-                           const std::string& password = "taosdata",
-                           int port = 6030,
-                           int nside_base_param = 64,
-                           int nside_fine_param = 256,
-                           int count_threshold_param = 10000,
-                           int batch_size_param = 500,
-                           int thread_count_param = 8)
-        : conn(nullptr), db_name(database), table_name("sensor_data"),
-          nside_base(nside_base_param), nside_fine(nside_fine_param),
-          count_threshold(count_threshold_param), batch_size(batch_size_param),
-          thread_count(thread_count_param) {
-        
-        // 初始化 HealPix
-        healpix_base = std::make_unique<Healpix_Base>(nside_base, NEST, SET_NSIDE);
-        healpix_fine = std::make_unique<Healpix_Base>(nside_fine, NEST, SET_NSIDE);
-        std::cout << "✅ HealPix 初始化成功，基础NSIDE=" << nside_base 
-                 << "，细分NSIDE=" << nside_fine << std::endl;
-        
-        // 初始化 TDengine
-        taos_init();
-        
-        // 连接数据库
-        conn = taos_connect(host.c_str(), user.c_str(), password.c_str(), nullptr, port);
-        if (conn == nullptr) {
-            throw std::runtime_error("无法连接到 TDengine: " + std::string(taos_errstr(conn)));
+    struct EntryHash {
+        size_t operator()(const std::pair<int64_t, uint64_t>& key) const {
+            return std::hash<int64_t>()(key.first) ^ (std::hash<uint64_t>()(key.second) * 0x9e3779b97f4a7c15ULL);
         }
-        std::cout << "✅ TDengine 连接成功" << std::endl;
-        
-        // 初始化连接池
-        conn_pool = std::make_unique<TDengineConnectionPool>(host, user, password, database, port, thread_count);
+    };
+
+    int fd_ = -1;
+    std::string path_;
+    std::mutex mutex_;
+    std::vector<Entry> pending_;
+    std::unordered_set<std::pair<int64_t, uint64_t>, EntryHash> done_;
+    double sync_interval_s_;
+    std::chrono::high_resolution_clock::time_point last_sync_;
+    size_t written_ = 0;
+    bool failed_ = false;
+
+    static std::pair<int64_t, uint64_t> key(long healpix_id, int source_id, uint32_t chunk) {
+        return {healpix_id, (static_cast<uint64_t>(static_cast<uint32_t>(source_id)) << 32) | chunk};
     }
-    
-    ~TDengineHealpixImporter() {
-        if (conn) {
-            taos_close(conn);
+
+    // 写入或同步失败时保留未落盘的记录并停用日志：之后完成的任务不再记录，续传时会重做（写入幂等）
+    void flushLocked() {
+        if (fd_ < 0 || pending_.empty()) return;
+        const char* data = reinterpret_cast<const char*>(pending_.data());
+        size_t total = pending_.size() * sizeof(Entry);
+        size_t written_bytes = 0;
+        while (written_bytes < total) {
+            ssize_t n = ::write(fd_, data + written_bytes, total - written_bytes);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            written_bytes += static_cast<size_t>(n);
         }
-        taos_cleanup();
+        bool ok = written_bytes == total;
+        if (!ok || ::fsync(fd_) != 0) {
+            std::cerr << "⚠️ 检查点写入失败，已停用检查点: " << path_ << " (" << std::strerror(errno) << ")" << std::endl;
+            // 只有整条写入的记录算数，写了一半的尾部记录在续传时被截掉
+            size_t whole = ok ? 0 : written_bytes / sizeof(Entry);
+            written_ += whole;
+            pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(whole));
+            ::close(fd_);
+            fd_ = -1;
+            failed_ = true;
+            return;
+        }
+        written_ += pending_.size();
+        pending_.clear();
+        last_sync_ = std::chrono::high_resolution_clock::now();
     }
-    
-    bool dropDatabase() {
-        std::cout << "⚠️ 正在删除数据库: " << db_name << std::endl;
-        
-        std::string sql = "DROP DATABASE IF EXISTS " + db_name;
-        TAOS_RES* result = taos_query(conn, sql.c_str());
-        
-        if (taos_errno(result) != 0) {
-            std::cerr << "❌ 删除数据库失败: " << taos_errstr(result) << std::endl;
-            taos_free_result(result);
+
+public:
+    explicit CheckpointJournal(double sync_interval_s = 5.0) : sync_interval_s_(sync_interval_s) {}
+
+    ~CheckpointJournal() { close(); }
+
+    // resume 为 true 时载入已有日志并在末尾继续追加，否则重建日志
+    bool open(const std::string& path, uint64_t fingerprint, bool resume, std::string& error) {
+        path_ = path;
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) std::filesystem::create_directories(parent);
+
+        if (resume) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open()) {
+                error = "检查点文件不存在: " + path;
+                return false;
+            }
+            char magic[8];
+            uint64_t stored_fingerprint = 0;
+            in.read(magic, sizeof(magic));
+            in.read(reinterpret_cast<char*>(&stored_fingerprint), sizeof(stored_fingerprint));
+            if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+                error = "检查点文件格式无效: " + path;
+                return false;
+            }
+            if (stored_fingerprint != fingerprint) {
+                error = "检查点与当前输入文件或分区参数不匹配: " + path;
+                return false;
+            }
+            Entry entry;
+            size_t entries_read = 0;  // 按读到的完整记录数计，日志中可能有重复记录
+            while (in.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+                done_.insert(key(entry.healpix_id, entry.source_id, entry.chunk));
+                entries_read++;
+            }
+            in.close();
+
+            // 丢弃崩溃时写了一半的尾部记录
+            size_t valid_size = sizeof(MAGIC) + sizeof(uint64_t) + entries_read * sizeof(Entry);
+            std::error_code ec;
+            if (std::filesystem::file_size(path, ec) > valid_size) {
+                std::filesystem::resize_file(path, valid_size, ec);
+            }
+            fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        } else {
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd_ >= 0) {
+                bool ok = ::write(fd_, MAGIC, sizeof(MAGIC)) == static_cast<ssize_t>(sizeof(MAGIC)) &&
+                          ::write(fd_, &fingerprint, sizeof(fingerprint)) == static_cast<ssize_t>(sizeof(fingerprint));
+                if (ok) {
+                    ::fsync(fd_);
+                } else {
+                    ::close(fd_);
+                    fd_ = -1;
+                }
+            }
+        }
+        if (fd_ < 0) {
+            error = "无法打开检查点文件: " + path + " (" + std::strerror(errno) + ")";
             return false;
         }
-        
-        taos_free_result(result);
-        std::cout << "✅ 数据库 " << db_name << " 已删除" << std::endl;
+        last_sync_ = std::chrono::high_resolution_clock::now();
         return true;
     }
+
+    bool isDone(long healpix_id, int source_id, uint32_t chunk) const {
+        return done_.count(key(healpix_id, source_id, chunk)) > 0;
+    }
+
+    void markDone(long healpix_id, int source_id, uint32_t chunk) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back({healpix_id, source_id, chunk});
+        auto now = std::chrono::high_resolution_clock::now();
+        if (pending_.size() >= SYNC_EVERY ||
+            std::chrono::duration<double>(now - last_sync_).count() >= sync_interval_s_) {
+            flushLocked();
+        }
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flushLocked();
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    size_t loadedCount() const { return done_.size(); }
+    size_t writtenCount() const { return written_; }
+    bool failed() const { return failed_; }
+    const std::string& path() const { return path_; }
+};
+
+// 写入错误分类：可重试（超时、网络、vnode 繁忙/未就绪、leader 切换）与永久（语法、表结构等）
+enum class WriteErrorClass { RETRYABLE, PERMANENT };
+
+inline WriteErrorClass classifyWriteError(int code, const std::string& message) {
+    uint32_t ucode = static_cast<uint32_t>(code);
+    // 解析器/语法错误段
+    if (ucode >= 0x80002600 && ucode <= 0x800026FF) return WriteErrorClass::PERMANENT;
+    // 同步模块（leader 不可用、选举中）
+    if (ucode >= 0x80000900 && ucode <= 0x800009FF) return WriteErrorClass::RETRYABLE;
     
-    bool createSuperTable() {
-        std::cout << "🏗️ 创建数据库和超级表..." << std::endl;
-        
-        // 创建数据库
-        std::string create_db_sql = "CREATE DATABASE IF NOT EXISTS " + db_name;
-        TAOS_RES* result = taos_query(conn, create_db_sql.c_str());
-        if (taos_errno(result) != 0) {
-            std::cerr << "❌ 创建数据库失败: " << taos_errstr(result) << std::endl;
-            taos_free_result(result);
-            return false;
+    static const char* const transient_markers[] = {
+        "timeout", "Timeout", "timed out", "busy", "Busy", "not ready", "Not ready",
+        "Unable to establish", "Conn is broken", "Network", "network", "unavailable",
+        "Sync leader", "restoring", "Out of memory in", "queue is full", "Too many", "retry"
+    };
+    for (const char* marker : transient_markers) {
+        if (message.find(marker) != std::string::npos) return WriteErrorClass::RETRYABLE;
+    }
+    return WriteErrorClass::PERMANENT;
+}
+
+// 指数退避（含全抖动），attempt 从 0 开始
+inline std::chrono::milliseconds retryBackoff(int attempt) {
+    static constexpr int BASE_MS = 100;
+    static constexpr int MAX_MS = 5000;
+    thread_local std::mt19937 rng(std::random_device{}());
+    int ceiling = std::min(MAX_MS, BASE_MS << std::min(attempt, 10));
+    std::uniform_int_distribution<int> jitter(0, ceiling);
+    return std::chrono::milliseconds(jitter(rng));
+}
+
+// 死信文件：永久失败（或重试耗尽）的批次按二进制追加，可用 --replay_dead_letter 重放
+// 文件头 "HPDLQ001"；每条记录：
+//   int64 healpix_id, int32 source_id, int32 error_code, uint32 row_count,
+//   uint16 message_len, message,
+//   row_count × { uint8 ts_len, ts, double ra, double dec, double mag, double jd_tcb }
+class DeadLetterWriter {
+private:
+    static constexpr char MAGIC[8] = {'H', 'P', 'D', 'L', 'Q', '0', '0', '1'};
+    std::string path_;
+    std::ofstream out_;
+    std::mutex mutex_;
+    size_t batches_ = 0;
+    bool append_;
+
+    template <typename T>
+    void put(const T& value) { out_.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+public:
+    // append 为 true 时接在已有死信文件之后写（单元被接管重跑时保留上一次的失败行）
+    explicit DeadLetterWriter(const std::string& path, bool append = false) : path_(path), append_(append) {}
+
+    void write(long healpix_id, int source_id, int error_code, const std::string& message,
+               const AstronomicalRecord* const* rows, size_t count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!out_.is_open()) {
+            std::filesystem::path parent = std::filesystem::path(path_).parent_path();
+            if (!parent.empty()) std::filesystem::create_directories(parent);
+            std::error_code ec;
+            bool resume = append_ && std::filesystem::file_size(path_, ec) >= sizeof(MAGIC) && !ec;
+            out_.open(path_, std::ios::binary | (resume ? std::ios::app : std::ios::trunc));
+            if (!out_.is_open()) return;
+            if (!resume) out_.write(MAGIC, sizeof(MAGIC));
         }
-        taos_free_result(result);
-        
-        // 使用数据库
-        std::string use_db_sql = "USE " + db_name;
-        result = taos_query(conn, use_db_sql.c_str());
-        if (taos_errno(result) != 0) {
-            std::cerr << "❌ 使用数据库失败: " << taos_errstr(result) << std::endl;
-            taos_free_result(result);
+        put<int64_t>(healpix_id);
+        put<int32_t>(source_id);
+        put<int32_t>(error_code);
+        put<uint32_t>(static_cast<uint32_t>(count));
+        uint16_t message_len = static_cast<uint16_t>(std::min<size_t>(message.size(), 65535));
+        put(message_len);
+        out_.write(message.data(), message_len);
+        for (size_t i = 0; i < count; ++i) {
+            const AstronomicalRecord& record = *rows[i];
+            uint8_t ts_len = static_cast<uint8_t>(std::min<size_t>(record.timestamp.size(), 255));
+            put(ts_len);
+            out_.write(record.timestamp.data(), ts_len);
+            put(record.ra);
+            put(record.dec);
+            put(record.mag);
+            put(record.jd_tcb);
+        }
+        out_.flush();
+        batches_++;
+    }
+
+    size_t batches() const { return batches_; }
+    const std::string& path() const { return path_; }
+
+    // 读取死信文件，恢复为带 healpix_id 的记录
+    static bool read(const std::string& path, std::vector<AstronomicalRecord>& records, std::string& error) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            error = "无法打开死信文件: " + path;
             return false;
         }
-        taos_free_result(result);
-        
-        // 创建超级表
-        std::string create_table_sql = 
-            "CREATE STABLE IF NOT EXISTS " + table_name + " ("
-            "ts TIMESTAMP, "
-            "ra DOUBLE, "
-            "dec DOUBLE, "
-            "mag DOUBLE, "
-            "jd_tcb DOUBLE"
-            ") TAGS (healpix_id BIGINT, source_id BIGINT)";
-        
-        result = taos_query(conn, create_table_sql.c_str());
-        if (taos_errno(result) != 0) {
-            std::cerr << "❌ 创建超级表失败: " << taos_errstr(result) << std::endl;
-            taos_free_result(result);
+        char magic[8];
+        in.read(magic, sizeof(magic));
+        if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+            error = "死信文件格式无效: " + path;
             return false;
         }
-        taos_free_result(result);
-        
-        std::cout << "✅ 超级表 " << table_name << " 已创建" << std::endl;
+        auto get = [&in](auto& value) {
+            in.read(reinterpret_cast<char*>(&value), sizeof(value));
+            return static_cast<bool>(in);
+        };
+        while (true) {
+            int64_t healpix_id;
+            int32_t source_id, error_code;
+            uint32_t count;
+            uint16_t message_len;
+            if (!get(healpix_id)) break;
+            if (!get(source_id) || !get(error_code) || !get(count) || !get(message_len)) {
+                error = "死信文件截断: " + path;
+                return false;
+            }
+            in.ignore(message_len);
+            for (uint32_t i = 0; i < count; ++i) {
+                AstronomicalRecord record;
+                uint8_t ts_len;
+                if (!get(ts_len)) break;
+                record.timestamp.resize(ts_len);
+                in.read(&record.timestamp[0], ts_len);
+                if (!get(record.ra) || !get(record.dec) || !get(record.mag) || !get(record.jd_tcb)) break;
+                record.source_id = source_id;
+                record.healpix_id = healpix_id;
+                record.ts_ms = parseTimestampMs(record.timestamp);
+                records.push_back(std::move(record));
+            }
+            if (!in) {
+                error = "死信文件截断: " + path;
+                return false;
+            }
+        }
         return true;
     }
-    
-    // 简化的自适应HealPix ID计算
-    long calculateAdaptiveHealpixId(double ra, double dec, int source_id, 
-                                   const std::map<long, int>& base_counts) {
-        // 验证和裁剪坐标值到有效范围
-        ra = fmod(ra, 360.0);
-        if (ra < 0) ra += 360.0;  // 确保 RA 在 [0, 360) 范围内
-        
-        dec = std::max(-90.0, std::min(90.0, dec));  // 裁剪 DEC 到 [-90, 90] 范围
-        
-        // 计算基础分辨率的 healpix ID
-        pointing pt(deg2rad(90.0 - dec), deg2rad(ra));
-        long base_id = healpix_base->ang2pix(pt);
-        
-        // 检查是否需要细分
-        auto it = base_counts.find(base_id);
-        int count = (it != base_counts.end()) ? it->second : 0;
+};
+
+// 延迟直方图：按 2 的幂划分微秒桶，无锁累加，百分位取桶上界
+class LatencyHistogram {
+private:
+    static constexpr int BUCKETS = 40;
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> total_us_{0};
+    std::atomic<uint64_t> max_us_{0};
+
+public:
+    void record(double micros) {
+        uint64_t us = micros > 0.0 ? static_cast<uint64_t>(micros) : 0;
+        int bucket = 0;
+        while (bucket < BUCKETS - 1 && (1ULL << bucket) <= us) ++bucket;
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        total_us_.fetch_add(us, std::memory_order_relaxed);
+        uint64_t prev = max_us_.load(std::memory_order_relaxed);
+        while (us > prev && !max_us_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return count_; }
+
+    double percentileMs(double p) const {
+        uint64_t total = count_;
+        if (total == 0) return 0.0;
+        uint64_t target = static_cast<uint64_t>(std::ceil(total * p));
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += buckets_[b].load(std::memory_order_relaxed);
+            if (seen >= target) return std::min<double>(1ULL << b, max_us_.load()) / 1000.0;
+        }
+        return max_us_ / 1000.0;
+    }
+
+    std::string summary() const {
+        std::ostringstream oss;
+        uint64_t n = count_;
+        oss << std::fixed << std::setprecision(2)
+            << "n=" << n
+            << " avg=" << (n > 0 ? total_us_ / 1000.0 / n : 0.0) << "ms"
+            << " p50=" << percentileMs(0.50) << "ms"
+            << " p95=" << percentileMs(0.95) << "ms"
+            << " p99=" << percentileMs(0.99) << "ms"
+            << " max=" << max_us_ / 1000.0 << "ms";
+        return oss.str();
+    }
+};
+
+// 分阶段计时：每个线程槽位一组无锁累加器（按缓存行对齐，避免伪共享）
+// 工作线程按 g_worker_slot 落在自己的槽位，其余线程（主线程、预建表、排序线程）落在最后一个公共槽位
+enum class Stage : int {
+    READ, PARSE, PIXELIZE, COUNT, GROUP, CREATE_TABLES, BUILD_SQL, NETWORK_WAIT, COMMIT
+};
+
+class StageTimers {
+public:
+    static constexpr int STAGES = 9;
+
+private:
+    struct alignas(64) Slot {
+        std::array<std::atomic<uint64_t>, STAGES> ns{};
+    };
+    
+    int slots_;
+    std::unique_ptr<Slot[]> data_;
+    Slot& slot() {
+        int index = (g_worker_slot >= 0 && g_worker_slot < slots_ - 1) ? g_worker_slot : slots_ - 1;
+        return data_[index];
+    }
+
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    explicit StageTimers(int worker_count)
+        : slots_(worker_count + 1), data_(new Slot[worker_count + 1]) {}
+    
+    static const char* name(Stage stage) {
+        static const char* const names[STAGES] = {
+            "read", "parse", "pixelize", "count", "group",
+            "table_creation", "statement_build", "network_wait", "commit"
+        };
+        return names[static_cast<int>(stage)];
+    }
+    
+    static const char* label(Stage stage) {
+        static const char* const labels[STAGES] = {
+            "读取", "解析", "像素化", "计数/分区决策", "分组排序",
+            "建表", "拼接语句", "等待 (取连接/限速/退避)", "提交 (服务端往返)"
+        };
+        return labels[static_cast<int>(stage)];
+    }
+    
+    void add(Stage stage, Clock::duration elapsed) {
+        slot().ns[static_cast<int>(stage)].fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+    }
+    
+    double seconds(Stage stage) const {
+        uint64_t total = 0;
+        for (int i = 0; i < slots_; ++i) total += data_[i].ns[static_cast<int>(stage)].load(std::memory_order_relaxed);
+        return total / 1e9;
+    }
+    
+    // worker_id == workerCount() 表示公共槽位
+    double workerSeconds(int worker_id, Stage stage) const {
+        return data_[worker_id].ns[static_cast<int>(stage)].load(std::memory_order_relaxed) / 1e9;
+    }
+    
+    int workerCount() const { return slots_ - 1; }
+    
+    // 作用域计时
+    class Scope {
+    public:
+        Scope(StageTimers& timers, Stage stage) : timers_(timers), stage_(stage), start_(Clock::now()) {}
+        ~Scope() { timers_.add(stage_, Clock::now() - start_); }
+    private:
+        StageTimers& timers_;
+        Stage stage_;
+        Clock::time_point start_;
+    };
+};
+
+// 写入限速：行/秒与字节/秒两个令牌桶，桶容量为 1 秒的配额
+// 允许透支：先扣令牌，再按欠额睡眠，单个大批不会被永久阻塞；速率为 0 表示不限
+class IngestRateLimiter {
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    std::mutex mutex_;
+    double rows_rate_ = 0.0;
+    double bytes_rate_ = 0.0;
+    double row_tokens_ = 0.0;
+    double byte_tokens_ = 0.0;
+    Clock::time_point last_refill_ = Clock::now();
+    std::atomic<bool> limited_{false};
+    std::atomic<uint64_t> throttled_batches_{0};
+    LatencyHistogram throttle_wait_;
+    
+    static double refill(double tokens, double rate, double elapsed_s) {
+        if (rate <= 0.0) return 0.0;
+        return std::min(rate, tokens + rate * elapsed_s);
+    }
+
+public:
+    void setRates(double rows_per_sec, double bytes_per_sec) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rows_rate_ = std::max(0.0, rows_per_sec);
+        bytes_rate_ = std::max(0.0, bytes_per_sec);
+        row_tokens_ = std::min(row_tokens_, rows_rate_);
+        byte_tokens_ = std::min(byte_tokens_, bytes_rate_);
+        limited_ = rows_rate_ > 0.0 || bytes_rate_ > 0.0;
+    }
+    
+    // 写入前调用，必要时阻塞到配额允许
+    void acquire(size_t rows, size_t bytes) {
+        if (!limited_.load(std::memory_order_relaxed)) return;
+        double wait_s = 0.0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto now = Clock::now();
+            double elapsed_s = std::chrono::duration<double>(now - last_refill_).count();
+            last_refill_ = now;
+            row_tokens_ = refill(row_tokens_, rows_rate_, elapsed_s);
+            byte_tokens_ = refill(byte_tokens_, bytes_rate_, elapsed_s);
+            if (rows_rate_ > 0.0) {
+                row_tokens_ -= static_cast<double>(rows);
+                if (row_tokens_ < 0.0) wait_s = std::max(wait_s, -row_tokens_ / rows_rate_);
+            }
+            if (bytes_rate_ > 0.0) {
+                byte_tokens_ -= static_cast<double>(bytes);
+                if (byte_tokens_ < 0.0) wait_s = std::max(wait_s, -byte_tokens_ / bytes_rate_);
+            }
+        }
+        if (wait_s > 0.0) {
+            throttled_batches_.fetch_add(1, std::memory_order_relaxed);
+            throttle_wait_.record(wait_s * 1e6);
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait_s));
+        }
+    }
+    
+    double rowsRate() { std::lock_guard<std::mutex> lock(mutex_); return rows_rate_; }
+    double bytesRate() { std::lock_guard<std::mutex> lock(mutex_); return bytes_rate_; }
+    uint64_t throttledBatches() const { return throttled_batches_; }
+    const LatencyHistogram& throttleWait() const { return throttle_wait_; }
+};
+
+// 限速与 QoS 配置
+struct RateLimitConfig {
+    double rows_per_sec = 0.0;      // 0 表示不限
+    double bytes_per_sec = 0.0;
+    std::string control_file;       // 运行时调整速率的控制文件（轮询 + SIGHUP 立即重读）
+    std::string probe_sql;          // 反馈模式的探测查询
+    double probe_target_ms = 0.0;   // 探测查询延迟目标，超过即收紧导入速率
+    
+    bool active() const {
+        return rows_per_sec > 0.0 || bytes_per_sec > 0.0 || !control_file.empty() ||
+               (!probe_sql.empty() && probe_target_ms > 0.0);
+    }
+};
+
+// SIGHUP 只置位，由 QoS 线程在下一轮轮询时重读控制文件
+static volatile std::sig_atomic_t g_rate_reload_requested = 0;
+
+extern "C" void onRateReloadSignal(int) {
+    g_rate_reload_requested = 1;
+}
+
+// QoS 调速线程
+// 1. 轮询控制文件（rows_per_sec= / bytes_per_sec=，每行一项，# 开头为注释），变化或收到 SIGHUP 时重读，作为速率上限
+// 2. 反馈模式：每秒执行一次探测查询，延迟超过目标时行速率乘 0.7，低于目标 70% 时加性恢复（每次 +10%），直至上限
+class IngestQosGovernor {
+private:
+    static constexpr double DECREASE_FACTOR = 0.7;
+    static constexpr double RECOVER_RATIO = 0.7;
+    static constexpr double INCREASE_STEP = 0.1;
+    static constexpr double MIN_ROWS_RATE = 100.0;
+    
+    IngestRateLimiter& limiter_;
+    RateLimitConfig config_;
+    std::function<long()> rows_written_;
+    std::function<void(const std::string&)> logger_;
+    TAOS* probe_conn_ = nullptr;
+    
+    double ceiling_rows_;
+    double ceiling_bytes_;
+    double feedback_rows_ = 0.0;    // 反馈模式施加的行速率，0 表示未收紧
+    std::filesystem::file_time_type control_mtime_{};
+    
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+    std::vector<std::string> decisions_;
+    LatencyHistogram probe_latency_;
+    
+    void log(const std::string& message) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            decisions_.push_back(message);
+        }
+        if (logger_) logger_("🚦 " + message);
+    }
+    
+    void applyRates() {
+        double rows = ceiling_rows_;
+        if (feedback_rows_ > 0.0) {
+            rows = (rows > 0.0) ? std::min(rows, feedback_rows_) : feedback_rows_;
+        }
+        limiter_.setRates(rows, ceiling_bytes_);
+    }
+    
+    void reloadControlFile(bool force) {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(config_.control_file, ec);
+        if (ec || (!force && mtime == control_mtime_)) return;
+        control_mtime_ = mtime;
+        
+        std::ifstream file(config_.control_file);
+        if (!file.is_open()) return;
+        double rows = ceiling_rows_;
+        double bytes = ceiling_bytes_;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) continue;
+            std::string key = line.substr(0, eq);
+            double value = std::atof(line.c_str() + eq + 1);
+            if (key == "rows_per_sec") rows = value;
+            else if (key == "bytes_per_sec") bytes = value;
+        }
+        if (rows != ceiling_rows_ || bytes != ceiling_bytes_) {
+            ceiling_rows_ = rows;
+            ceiling_bytes_ = bytes;
+            log("控制文件: 行速率上限 " + std::to_string(static_cast<long>(rows)) + "/s，字节速率上限 " +
+                std::to_string(static_cast<long>(bytes)) + "/s (0=不限)");
+            applyRates();
+        }
+    }
+    
+    // 返回探测查询延迟（毫秒），失败返回负值
+    double runProbe() {
+        auto start = std::chrono::steady_clock::now();
+        TAOS_RES* result = taos_query(probe_conn_, config_.probe_sql.c_str());
+        if (taos_errno(result) != 0) {
+            std::string error = taos_errstr(result);
+            taos_free_result(result);
+            log("探测查询失败: " + error);
+            return -1.0;
+        }
+        while (taos_fetch_row(result) != nullptr) {}
+        taos_free_result(result);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        probe_latency_.record(ms * 1000.0);
+        return ms;
+    }
+    
+    void adjustFromProbe(double probe_ms, double observed_rows_rate) {
+        if (probe_ms > config_.probe_target_ms) {
+            double base = feedback_rows_ > 0.0 ? feedback_rows_
+                        : (ceiling_rows_ > 0.0 ? std::min(ceiling_rows_, observed_rows_rate) : observed_rows_rate);
+            if (base <= 0.0) return;
+            feedback_rows_ = std::max(MIN_ROWS_RATE, base * DECREASE_FACTOR);
+            std::ostringstream msg;
+            msg << std::fixed << std::setprecision(1) << "探测延迟 " << probe_ms << "ms > 目标 "
+                << config_.probe_target_ms << "ms，行速率收紧至 " << static_cast<long>(feedback_rows_) << "/s";
+            log(msg.str());
+            applyRates();
+        } else if (feedback_rows_ > 0.0 && probe_ms < config_.probe_target_ms * RECOVER_RATIO) {
+            double next = feedback_rows_ * (1.0 + INCREASE_STEP);
+            // 达到上限（或无上限时已明显高于实际吞吐）即解除反馈限速
+            bool release = (ceiling_rows_ > 0.0) ? next >= ceiling_rows_
+                                                 : (observed_rows_rate > 0.0 && next >= 2.0 * observed_rows_rate);
+            feedback_rows_ = release ? 0.0 : next;
+            log(release ? std::string("探测延迟恢复，解除反馈限速")
+                        : "探测延迟恢复，行速率放宽至 " + std::to_string(static_cast<long>(feedback_rows_)) + "/s");
+            applyRates();
+        }
+    }
+    
+    void run() {
+        long last_rows = rows_written_ ? rows_written_() : 0;
+        auto last_time = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_cv_.wait_for(lock, std::chrono::seconds(1), [this] { return stop_; })) {
+            lock.unlock();
+            if (!config_.control_file.empty()) {
+                bool force = g_rate_reload_requested != 0;
+                g_rate_reload_requested = 0;
+                reloadControlFile(force);
+            }
+            if (probe_conn_) {
+                auto now = std::chrono::steady_clock::now();
+                long rows = rows_written_ ? rows_written_() : 0;
+                double elapsed_s = std::chrono::duration<double>(now - last_time).count();
+                double observed = elapsed_s > 0.0 ? (rows - last_rows) / elapsed_s : 0.0;
+                last_rows = rows;
+                last_time = now;
+                double probe_ms = runProbe();
+                if (probe_ms >= 0.0) adjustFromProbe(probe_ms, observed);
+            }
+            lock.lock();
+        }
+    }
+
+public:
+    IngestQosGovernor(IngestRateLimiter& limiter, const RateLimitConfig& config,
+                      const std::string& host, const std::string& user, const std::string& password,
+                      const std::string& db_name, int port,
+                      std::function<long()> rows_written,
+                      std::function<void(const std::string&)> logger)
+        : limiter_(limiter), config_(config), rows_written_(std::move(rows_written)),
+          logger_(std::move(logger)), ceiling_rows_(config.rows_per_sec), ceiling_bytes_(config.bytes_per_sec) {
+        
+        if (!config_.control_file.empty()) {
+            reloadControlFile(true);
+            std::signal(SIGHUP, onRateReloadSignal);
+        }
+        applyRates();
+        
+        // 探测查询使用独立连接，不占用导入连接池
+        if (!config_.probe_sql.empty() && config_.probe_target_ms > 0.0) {
+            probe_conn_ = taos_connect(host.c_str(), user.c_str(), password.c_str(), db_name.c_str(), port);
+            if (probe_conn_ == nullptr) {
+                std::cerr << "⚠️ 探测连接失败，反馈限速未启用" << std::endl;
+            }
+        }
+        thread_ = std::thread(&IngestQosGovernor::run, this);
+    }
+    
+    ~IngestQosGovernor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        stop_cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+        if (probe_conn_) taos_close(probe_conn_);
+        if (!config_.control_file.empty()) std::signal(SIGHUP, SIG_DFL);
+    }
+    
+    bool feedbackEnabled() const { return probe_conn_ != nullptr; }
+    const LatencyHistogram& probeLatency() const { return probe_latency_; }
+    
+    std::vector<std::string> decisions() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return decisions_;
+    }
+};
+
+// 判断错误是否意味着连接本身已不可用（归还时应丢弃并重建）
+inline bool isConnectionError(const std::string& message) {
+    return message.find("Unable to establish") != std::string::npos ||
+           message.find("Conn is broken") != std::string::npos ||
+           message.find("Network") != std::string::npos ||
+           message.find("network") != std::string::npos;
+}
+
+// 写入后端：导入器对服务端的全部写操作（建库建表、INSERT、连接与探活）都经由此接口
+//   taos      真实 TDengine
+//   null      直接丢弃，测量客户端解析/分区/拼 SQL 的极限吞吐
+//   simulated 进程内模拟：固定延迟（±20% 抖动）、全局行吞吐上限、可重试/永久错误注入
+// 非 taos 后端的连接句柄只是占位对象，不可传给 taos_* 函数
+class WriteBackend {
+public:
+    virtual ~WriteBackend() = default;
+    virtual std::string name() const = 0;
+    virtual std::string describe() const { return name(); }
+    // 是否连接真实服务端；否则元数据查询（子表目录、探测查询）不可用
+    virtual bool isServer() const { return false; }
+    virtual TAOS* connect(const std::string& host, const std::string& user,
+                          const std::string& password, int port) = 0;
+    virtual void close(TAOS* conn) = 0;
+    // 执行一条不返回结果集的语句；失败时填入错误码与错误信息
+    virtual bool execute(TAOS* conn, const std::string& sql, int& code, std::string& message) = 0;
+};
+
+class TaosWriteBackend : public WriteBackend {
+public:
+    std::string name() const override { return "taos"; }
+    bool isServer() const override { return true; }
+    
+    TAOS* connect(const std::string& host, const std::string& user,
+                  const std::string& password, int port) override {
+        return taos_connect(host.c_str(), user.c_str(), password.c_str(), nullptr, port);
+    }
+    
+    void close(TAOS* conn) override {
+        taos_close(conn);
+    }
+    
+    bool execute(TAOS* conn, const std::string& sql, int& code, std::string& message) override {
+        TAOS_RES* result = taos_query(conn, sql.c_str());
+        code = taos_errno(result);
+        if (code != 0) {
+            message = taos_errstr(result);
+        }
+        taos_free_result(result);
+        return code == 0;
+    }
+};
+
+class NullWriteBackend : public WriteBackend {
+public:
+    std::string name() const override { return "null"; }
+    
+    TAOS* connect(const std::string&, const std::string&, const std::string&, int) override {
+        return new char(0);
+    }
+    
+    void close(TAOS* conn) override {
+        delete static_cast<char*>(conn);
+    }
+    
+    bool execute(TAOS*, const std::string&, int& code, std::string&) override {
+        code = 0;
+        return true;
+    }
+};
+
+struct SimulatedBackendConfig {
+    double latency_ms = 5.0;        // 每条语句的基础延迟
+    double rows_per_sec = 0.0;      // 全局写入吞吐上限，0 表示不限
+    double error_rate = 0.0;        // 注入可重试错误（超时）的概率
+    double fatal_rate = 0.0;        // 注入永久错误（语法错误）的概率
+};
+
+class SimulatedWriteBackend : public NullWriteBackend {
+private:
+    SimulatedBackendConfig config_;
+    IngestRateLimiter ceiling_;     // 以令牌桶模拟服务端吞吐上限，各连接共享
+    std::atomic<uint64_t> statements_{0};
+    std::atomic<uint64_t> rows_{0};
+    std::atomic<uint64_t> injected_{0};
+    
+    // 每个 VALUES 元组以 "('" 开头（时间戳为字符串）
+    static size_t countRows(const std::string& sql) {
+        size_t rows = 0;
+        for (size_t pos = sql.find("('"); pos != std::string::npos; pos = sql.find("('", pos + 2)) {
+            rows++;
+        }
+        return rows;
+    }
+
+public:
+    explicit SimulatedWriteBackend(const SimulatedBackendConfig& config) : config_(config) {
+        ceiling_.setRates(config_.rows_per_sec, 0.0);
+    }
+    
+    std::string name() const override { return "simulated"; }
+    
+    std::string describe() const override {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(3) << "simulated (延迟 " << config_.latency_ms << "ms，吞吐上限 "
+            << static_cast<long>(config_.rows_per_sec) << " 行/秒，可重试错误率 " << config_.error_rate
+            << "，永久错误率 " << config_.fatal_rate << "；已执行 " << statements_ << " 条语句 / "
+            << rows_ << " 行，注入错误 " << injected_ << " 次)";
+        return oss.str();
+    }
+    
+    bool execute(TAOS*, const std::string& sql, int& code, std::string& message) override {
+        thread_local std::mt19937 rng(std::random_device{}());
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        statements_++;
+        
+        size_t rows = countRows(sql);
+        ceiling_.acquire(rows, sql.size());
+        if (config_.latency_ms > 0.0) {
+            double jitter = 0.8 + 0.4 * unit(rng);
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(config_.latency_ms * jitter));
+        }
+        
+        double draw = unit(rng);
+        if (draw < config_.fatal_rate) {
+            injected_++;
+            code = static_cast<int>(0x80002600);
+            message = "simulated syntax error";
+            return false;
+        }
+        if (draw < config_.fatal_rate + config_.error_rate) {
+            injected_++;
+            code = static_cast<int>(0x80000903);
+            message = "simulated Sync timeout";
+            return false;
+        }
+        rows_ += rows;
+        code = 0;
+        return true;
+    }
+};
+
+inline std::unique_ptr<WriteBackend> makeWriteBackend(const std::string& name, const SimulatedBackendConfig& config) {
+    if (name == "taos") return std::make_unique<TaosWriteBackend>();
+    if (name == "null") return std::make_unique<NullWriteBackend>();
+    if (name == "sim" || name == "simulated") return std::make_unique<SimulatedWriteBackend>(config);
+    return nullptr;
+}
+
+// TDengine 连接池
+// 连接数在 [min, max] 之间伸缩：并行建连，后台线程做健康检查、补足与回收空闲连接，
+// 取连接时池空且未达上限则就地扩容；记录取连接等待时间与持有时间的直方图
+class TDengineConnectionPool {
+private:
+    using Clock = std::chrono::high_resolution_clock;
+    
+    struct PooledConnection {
+        TAOS* conn;
+        int vgroup_affinity;          // -1 表示无亲和
+        Clock::time_point last_used;
+        Clock::time_point last_check;
+    };
+    
+    std::deque<PooledConnection> idle_;
+    std::unordered_map<TAOS*, std::pair<PooledConnection, Clock::time_point>> in_use_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable maintain_cv_;
+    WriteBackend& backend_;
+    std::string host_, user_, password_, db_name_;
+    int port_;
+    size_t min_size_;
+    size_t max_size_;
+    size_t total_ = 0;               // 空闲 + 使用中 + 正在建立
+    bool stopping_ = false;
+    std::thread maintainer_;
+    std::chrono::seconds health_interval_;
+    std::chrono::seconds idle_timeout_{60};
+    
+    LatencyHistogram wait_hist_;
+    LatencyHistogram hold_hist_;
+    std::atomic<int> created_{0};
+    std::atomic<int> failed_connects_{0};
+    std::atomic<int> dropped_{0};
+    
+    TAOS* openConnection() {
+        TAOS* conn = backend_.connect(host_, user_, password_, port_);
+        if (!conn) {
+            failed_connects_++;
+            return nullptr;
+        }
+        int code = 0;
+        std::string message;
+        if (!backend_.execute(conn, "USE " + db_name_, code, message)) {
+            backend_.close(conn);
+            failed_connects_++;
+            return nullptr;
+        }
+        created_++;
+        return conn;
+    }
+    
+    bool ping(TAOS* conn) {
+        int code = 0;
+        std::string message;
+        return backend_.execute(conn, "SELECT SERVER_STATUS()", code, message);
+    }
+    
+    // 并行建立 count 个连接并放入空闲队列；调用前已在 total_ 中预留名额
+    void openInParallel(size_t count) {
+        std::vector<std::future<TAOS*>> pending;
+        for (size_t i = 0; i < count; ++i) {
+            pending.push_back(std::async(std::launch::async, [this] { return openConnection(); }));
+        }
+        for (auto& f : pending) {
+            TAOS* conn = f.get();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (conn) {
+                auto now = Clock::now();
+                idle_.push_back({conn, -1, now, now});
+                cv_.notify_one();
+            } else {
+                total_--;
+            }
+        }
+    }
+    
+    void maintainLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            maintain_cv_.wait_for(lock, health_interval_, [this] { return stopping_; });
+            if (stopping_) break;
+            
+            // 取出到期的空闲连接做健康检查，检查期间不对外提供
+            auto now = Clock::now();
+            std::vector<PooledConnection> to_check;
+            for (auto it = idle_.begin(); it != idle_.end();) {
+                if (now - it->last_check >= health_interval_) {
+                    to_check.push_back(*it);
+                    it = idle_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            lock.unlock();
+            std::vector<PooledConnection> healthy;
+            for (auto& pc : to_check) {
+                if (ping(pc.conn)) {
+                    pc.last_check = Clock::now();
+                    healthy.push_back(pc);
+                } else {
+                    backend_.close(pc.conn);
+                    dropped_++;
+                }
+            }
+            lock.lock();
+            total_ -= to_check.size() - healthy.size();
+            for (auto& pc : healthy) {
+                idle_.push_back(pc);
+            }
+            
+            // 回收长时间空闲的多余连接
+            now = Clock::now();
+            while (total_ > min_size_ && !idle_.empty() && now - idle_.front().last_used > idle_timeout_) {
+                backend_.close(idle_.front().conn);
+                idle_.pop_front();
+                total_--;
+            }
+            
+            // 补足到最小连接数
+            if (total_ < min_size_) {
+                size_t missing = min_size_ - total_;
+                total_ += missing;
+                lock.unlock();
+                openInParallel(missing);
+                lock.lock();
+            }
+            cv_.notify_all();
+        }
+    }
+
+public:
+    TDengineConnectionPool(WriteBackend& backend, const std::string& host, const std::string& user, 
+                          const std::string& password, const std::string& db_name,
+                          int port, int min_size = 8, int max_size = 16, int health_interval_s = 10) 
+        : backend_(backend), host_(host), user_(user), password_(password), db_name_(db_name), 
+          port_(port), min_size_(std::max(1, min_size)),
+          max_size_(std::max(std::max(1, min_size), max_size)),
+          health_interval_(std::max(1, health_interval_s)) {
+        
+        // 并行初始化连接池
+        total_ = min_size_;
+        openInParallel(min_size_);
+        maintainer_ = std::thread(&TDengineConnectionPool::maintainLoop, this);
+        
+        std::cout << "✅ 连接池初始化完成，连接数: " << size() << " (范围 " << min_size_ << "-" << max_size_;
+        if (failed_connects_ > 0) {
+            std::cout << "，失败 " << failed_connects_ << " 个，后台重连";
+        }
+        std::cout << ")" << std::endl;
+    }
+
+    ~TDengineConnectionPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        maintain_cv_.notify_all();
+        if (maintainer_.joinable()) {
+            maintainer_.join();
+        }
+        for (auto& pc : idle_) {
+            backend_.close(pc.conn);
+        }
+        for (auto& entry : in_use_) {
+            backend_.close(entry.first);
+        }
+    }
+
+    // 优先返回亲和 vgroup 的连接；池空时未达上限则就地扩容，否则等待
+    TAOS* getConnection(int vgroup = -1) {
+        auto wait_start = Clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (idle_.empty()) {
+            if (total_ < max_size_) {
+                total_++;
+                lock.unlock();
+                TAOS* conn = openConnection();
+                lock.lock();
+                if (conn) {
+                    auto now = Clock::now();
+                    idle_.push_back({conn, -1, now, now});
+                    break;
+                }
+                total_--;
+            }
+            // 建连失败或已达上限：定时醒来重试，避免服务端恢复后仍永久阻塞
+            cv_.wait_for(lock, std::chrono::seconds(1));
+        }
+        
+        auto it = idle_.begin();
+        if (vgroup >= 0) {
+            auto match = std::find_if(idle_.begin(), idle_.end(),
+                                      [vgroup](const PooledConnection& pc) { return pc.vgroup_affinity == vgroup; });
+            if (match != idle_.end()) it = match;
+        }
+        PooledConnection pc = *it;
+        idle_.erase(it);
+        auto now = Clock::now();
+        in_use_[pc.conn] = {pc, now};
+        lock.unlock();
+        
+        wait_hist_.record(std::chrono::duration<double, std::micro>(now - wait_start).count());
+        return pc.conn;
+    }
+
+    // healthy 为 false 时关闭该连接，由后台线程补足
+    void returnConnection(TAOS* conn, bool healthy = true) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = in_use_.find(conn);
+        if (it == in_use_.end()) return;
+        PooledConnection pc = it->second.first;
+        auto now = Clock::now();
+        hold_hist_.record(std::chrono::duration<double, std::micro>(now - it->second.second).count());
+        in_use_.erase(it);
+        
+        if (healthy) {
+            pc.last_used = now;
+            idle_.push_back(pc);
+            cv_.notify_one();
+            return;
+        }
+        total_--;
+        dropped_++;
+        lock.unlock();
+        backend_.close(conn);
+        maintain_cv_.notify_all();
+    }
+
+    // 将现有连接按轮转方式绑定到给定 vgroup 列表
+    void assignAffinity(const std::vector<int>& vgroups) {
+        if (vgroups.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t next = 0;
+        for (auto& pc : idle_) {
+            pc.vgroup_affinity = vgroups[next++ % vgroups.size()];
+        }
+        for (auto& entry : in_use_) {
+            entry.second.first.vgroup_affinity = vgroups[next++ % vgroups.size()];
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return idle_.size() + in_use_.size();
+    }
+    
+    size_t minSize() const { return min_size_; }
+    size_t maxSize() const { return max_size_; }
+    int createdCount() const { return created_; }
+    int failedConnects() const { return failed_connects_; }
+    int droppedCount() const { return dropped_; }
+    const LatencyHistogram& waitHistogram() const { return wait_hist_; }
+    const LatencyHistogram& holdHistogram() const { return hold_hist_; }
+};
+
+// 工作任务结构：指向分组后记录指针数组的一段区间，不持有数据
+struct ImportTask {
+    long healpix_id;
+    int source_id;
+    const AstronomicalRecord* const* records;
+    size_t count;
+    size_t group_index;   // 所属子表在分组列表中的序号
+    uint32_t chunk;       // 分组内的子批序号，用作检查点键
+    bool create_table;    // 预建表阶段未覆盖时由任务自行建表
+    
+    ImportTask(long hid, int sid, const AstronomicalRecord* const* recs, size_t n, size_t group, uint32_t chunk_index)
+        : healpix_id(hid), source_id(sid), records(recs), count(n),
+          group_index(group), chunk(chunk_index), create_table(true) {}
+};
+
+// 任务分片：同一 vgroup 的任务序号（按行数降序）及其领取游标
+struct TaskShard {
+    int vgroup;                        // -1 表示未知 vgroup
+    std::vector<size_t> task_indices;
+    std::atomic<size_t> cursor{0};
+    
+    explicit TaskShard(int vg) : vgroup(vg) {}
+};
+
+// 分布式导入的作业目录（位于各导入进程都能访问的共享文件系统上）
+//   job.txt                输入文件路径、大小、修改时间、分区参数与作业指纹
+//   units.csv              工作单元：按行对齐的字节区间 unit_id,begin,end
+//   partition_map.csv      协调者基于完整输入计算的分区表，各进程冻结沿用
+//   leases/<id>.lease      租约：O_CREAT|O_EXCL 抢占，内容为 主机:进程号，持有者定期刷新修改时间
+//   done/<id>.done         完成标记：持有者、成功/失败行数、耗时
+//   checkpoints/<id>.ckpt  单元检查点，租约过期被接管时新持有者从断点继续
+//   sources/<id>.csv       单元内 source_id -> healpix_id 映射，全部完成后合并
+class ImportJobDirectory {
+public:
+    struct Unit {
+        int id;
+        uint64_t begin;
+        uint64_t end;
+    };
+    
+    struct Manifest {
+        std::string input;
+        uint64_t input_size = 0;
+        int64_t input_mtime = 0;
+        int nside_base = 0;
+        int nside_fine = 0;
+        int count_threshold = 0;
+        uint64_t fingerprint = 0;
+        std::vector<Unit> units;
+    };
+
+private:
+    std::string dir_;
+    std::string owner_;
+    
+    std::string unitFile(const char* sub, int id, const char* ext) const {
+        return dir_ + "/" + sub + "/" + std::to_string(id) + ext;
+    }
+
+public:
+    explicit ImportJobDirectory(const std::string& dir) : dir_(dir) {
+        char host[256] = {0};
+        gethostname(host, sizeof(host) - 1);
+        owner_ = std::string(host) + ":" + std::to_string(getpid());
+    }
+    
+    const std::string& dir() const { return dir_; }
+    const std::string& owner() const { return owner_; }
+    std::string partitionMapPath() const { return dir_ + "/partition_map.csv"; }
+    std::string leasePath(int id) const { return unitFile("leases", id, ".lease"); }
+    std::string donePath(int id) const { return unitFile("done", id, ".done"); }
+    std::string checkpointPath(int id) const { return unitFile("checkpoints", id, ".ckpt"); }
+    std::string sourcesPath(int id) const { return unitFile("sources", id, ".csv"); }
+    std::string sourceIndexPath(int id) const { return unitFile("sources", id, ".idx"); }
+    std::string deadLetterPath(int id) const { return unitFile("dead_letter", id, ".dlq"); }
+    
+    void create() const {
+        for (const char* sub : {"leases", "done", "checkpoints", "sources", "dead_letter"}) {
+            std::filesystem::create_directories(dir_ + "/" + sub);
+        }
+    }
+    
+    bool writeManifest(const Manifest& manifest) const {
+        std::ofstream job(dir_ + "/job.txt.tmp");
+        std::ofstream units(dir_ + "/units.csv.tmp");
+        if (!job.is_open() || !units.is_open()) return false;
+        job << "input=" << manifest.input << "\n"
+            << "input_size=" << manifest.input_size << "\n"
+            << "input_mtime=" << manifest.input_mtime << "\n"
+            << "nside_base=" << manifest.nside_base << "\n"
+            << "nside_fine=" << manifest.nside_fine << "\n"
+            << "count_threshold=" << manifest.count_threshold << "\n"
+            << "fingerprint=" << manifest.fingerprint << "\n"
+            << "units=" << manifest.units.size() << "\n";
+        units << "unit_id,begin,end\n";
+        for (const auto& unit : manifest.units) {
+            units << unit.id << "," << unit.begin << "," << unit.end << "\n";
+        }
+        job.close();
+        units.close();
+        // 先写单元表再写作业文件，作业文件出现即表示作业目录完整
+        std::filesystem::rename(dir_ + "/units.csv.tmp", dir_ + "/units.csv");
+        std::filesystem::rename(dir_ + "/job.txt.tmp", dir_ + "/job.txt");
+        return true;
+    }
+    
+    bool readManifest(Manifest& manifest, std::string& error) const {
+        std::ifstream job(dir_ + "/job.txt");
+        if (!job.is_open()) {
+            error = "作业目录未初始化（缺少 job.txt）: " + dir_;
+            return false;
+        }
+        std::string line;
+        while (std::getline(job, line)) {
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) continue;
+            std::string key = line.substr(0, eq);
+            std::string value = line.substr(eq + 1);
+            if (key == "input") manifest.input = value;
+            else if (key == "input_size") manifest.input_size = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "input_mtime") manifest.input_mtime = std::strtoll(value.c_str(), nullptr, 10);
+            else if (key == "nside_base") manifest.nside_base = std::atoi(value.c_str());
+            else if (key == "nside_fine") manifest.nside_fine = std::atoi(value.c_str());
+            else if (key == "count_threshold") manifest.count_threshold = std::atoi(value.c_str());
+            else if (key == "fingerprint") manifest.fingerprint = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        std::ifstream units(dir_ + "/units.csv");
+        std::getline(units, line);
+        while (std::getline(units, line)) {
+            Unit unit{};
+            unsigned long long begin = 0, end = 0;
+            if (std::sscanf(line.c_str(), "%d,%llu,%llu", &unit.id, &begin, &end) == 3) {
+                unit.begin = begin;
+                unit.end = end;
+                manifest.units.push_back(unit);
+            }
+        }
+        if (manifest.input.empty() || manifest.units.empty()) {
+            error = "作业目录内容不完整: " + dir_;
+            return false;
+        }
+        return true;
+    }
+    
+    bool isDone(int id) const {
+        return std::filesystem::exists(donePath(id));
+    }
+    
+    size_t doneCount(const Manifest& manifest) const {
+        size_t done = 0;
+        for (const auto& unit : manifest.units) {
+            if (isDone(unit.id)) done++;
+        }
+        return done;
+    }
+    
+    // 抢占单元租约；租约超过 ttl 未刷新视为持有者已失效，通过原子改名接管（只有一个进程能改名成功）
+    bool claim(int id, std::chrono::seconds ttl) const {
+        if (isDone(id)) return false;
+        std::string lease = leasePath(id);
+        int fd = ::open(lease.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            if (errno != EEXIST) return false;
+            std::error_code ec;
+            auto mtime = std::filesystem::last_write_time(lease, ec);
+            if (ec || std::filesystem::file_time_type::clock::now() - mtime < ttl) return false;
+            std::string stale = lease + ".stale." + owner_;
+            if (std::rename(lease.c_str(), stale.c_str()) != 0) return false;
+            std::filesystem::remove(stale, ec);
+            std::cout << "⏰ 接管过期租约: 单元 " << id << std::endl;
+            fd = ::open(lease.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (fd < 0) return false;
+        }
+        bool written = ::write(fd, owner_.data(), owner_.size()) == static_cast<ssize_t>(owner_.size());
+        ::close(fd);
+        // 检查与抢占之间单元可能刚好完成
+        if (!written || isDone(id)) {
+            std::error_code ec;
+            std::filesystem::remove(lease, ec);
+            return false;
+        }
+        return true;
+    }
+    
+    // 刷新租约修改时间；租约已被他人接管时返回 false
+    bool heartbeat(int id) const {
+        std::string lease = leasePath(id);
+        std::ifstream in(lease);
+        std::string holder((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (holder != owner_) return false;
+        std::error_code ec;
+        std::filesystem::last_write_time(lease, std::filesystem::file_time_type::clock::now(), ec);
+        return !ec;
+    }
+    
+    // 租约文件中的持有者是否仍是本进程
+    bool holds(int id) const {
+        std::ifstream in(leasePath(id));
+        std::string holder((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return holder == owner_;
+    }
+    
+    // 只释放本进程持有的租约，已被接管的租约留给新的持有者
+    void release(int id) const {
+        if (!holds(id)) return;
+        std::error_code ec;
+        std::filesystem::remove(leasePath(id), ec);
+    }
+    
+    // 租约已被接管时不写完成标记，返回 false
+    bool markDone(int id, long success, long errors, double seconds) const {
+        if (!holds(id)) return false;
+        std::string tmp = donePath(id) + ".tmp." + owner_;
+        {
+            std::ofstream done(tmp);
+            done << "owner=" << owner_ << "\nsuccess=" << success << "\nerrors=" << errors
+                 << "\nseconds=" << std::fixed << std::setprecision(2) << seconds << "\n";
+        }
+        std::filesystem::rename(tmp, donePath(id));
+        release(id);
+        return true;
+    }
+};
+
+class TDengineHealpixImporter {
+private:
+    static constexpr int SPLIT_BATCHES = 20;  // 单个任务最多包含的批数
+    
+    TAOS* conn;
+    std::string db_name;
+    std::string table_name;
+    int nside_base;
+    int nside_fine;
+    int count_threshold;
+    int batch_size;
+    int thread_count;
+    bool adaptive;
+    size_t max_sql_bytes;
+    bool precreate_tables;
+    int create_batch;
+    std::string checkpoint_path;
+    bool resume;
+    double checkpoint_interval;
+    bool checkpoint_enabled = true;
+    uint64_t input_fingerprint = 0;
+    int retry_times;
+    std::string dead_letter_path;
+    std::string host, user, password;
+    int port;
+    int pool_min;
+    int pool_max;
+    bool vgroup_routing;
+    RateLimitConfig rate_limit;
+    bool append;
+    std::string partition_map_path;
+    std::string source_index_path = "output/query_results/source_position_index.bin";
+    std::unordered_map<std::string, int> catalog;  // 追加模式：已有子表 -> vgroup
+    bool dry_run;
+    StageTimers timers;
+    std::string progress_json_path;
+    double progress_interval;
+    long last_success = 0;   // 最近一次 importData 的成功/失败行数
+    long last_errors = 0;
+    bool last_completed = false;  // 最近一次 importData 是否处理完全部任务（失败行已进死信，不算未完成）
+    std::atomic<bool> abort_import{false};  // 置位后工作线程不再领取新任务（工作进程丢失单元租约时）
+    int flush_rows;     // 流式模式：单个子表缓冲达到该行数即写入
+    int flush_ms;       // 流式模式：缓冲中最早一行等待超过该毫秒数即写入
+    std::unique_ptr<Healpix_Base> healpix_base;
+    std::unique_ptr<Healpix_Base> healpix_fine;
+    std::unique_ptr<WriteBackend> backend;
+    std::unique_ptr<TDengineConnectionPool> conn_pool;
+    std::unique_ptr<AdaptiveIngestController> controller;
+    std::unique_ptr<CheckpointJournal> journal;
+    std::unique_ptr<DeadLetterWriter> dead_letter;
+    IngestRateLimiter limiter;
+    std::unique_ptr<IngestQosGovernor> qos;
+    
+    // 组内时间排序统计
+    struct OrderingStats {
+        size_t groups = 0;
+        size_t reordered_groups = 0;
+        size_t out_of_order_rows = 0;   // 组内时间戳小于前一条的记录数
+        size_t duplicate_rows = 0;      // 合并掉的重复 (source_id, ts) 记录数
+        double seconds = 0.0;
+    } ordering;
+
+public:
+    TDengineHealpixImporter(const std::string& database,
+                           const std::string& host = "localhost",
+                           const std::string& user = "root",
+                           const std::string& password = "taosdata",
+                           int port = 6030,
+                           int nside_base_param = 64,
+                           int nside_fine_param = 256,
+                           int count_threshold_param = 10000,
+                           int batch_size_param = 500,
+                           int thread_count_param = 8,
+                           bool adaptive_param = false,
+                           size_t max_sql_bytes_param = 1048576,
+                           bool precreate_tables_param = false,
+                           int create_batch_param = 1000,
+                           const std::string& checkpoint_path_param = "",
+                           bool resume_param = false,
+                           double checkpoint_interval_param = 5.0,
+                           int retry_times_param = 3,
+                           const std::string& dead_letter_path_param = "",
+                           int pool_min_param = 0,
+                           int pool_max_param = 0,
+                           bool vgroup_routing_param = false,
+                           const RateLimitConfig& rate_limit_param = RateLimitConfig(),
+                           bool append_param = false,
+                           const std::string& partition_map_param = "",
+                           int flush_rows_param = 0,
+                           int flush_ms_param = 1000,
+                           std::unique_ptr<WriteBackend> backend_param = nullptr,
+                           bool dry_run_param = false,
+                           const std::string& progress_json_param = "",
+                           double progress_interval_param = 1.0)
+        : conn(nullptr), db_name(database), table_name("sensor_data"),
+          nside_base(nside_base_param), nside_fine(nside_fine_param),
+          count_threshold(count_threshold_param), batch_size(batch_size_param),
+          thread_count(thread_count_param), adaptive(adaptive_param),
+          max_sql_bytes(max_sql_bytes_param), precreate_tables(precreate_tables_param),
+          create_batch(create_batch_param), checkpoint_path(checkpoint_path_param),
+          resume(resume_param), checkpoint_interval(checkpoint_interval_param),
+          retry_times(retry_times_param), dead_letter_path(dead_letter_path_param),
+          host(host), user(user), password(password), port(port),
+          pool_min(pool_min_param > 0 ? pool_min_param : thread_count_param),
+          pool_max(pool_max_param > 0 ? pool_max_param : 2 * thread_count_param),
+          vgroup_routing(vgroup_routing_param), rate_limit(rate_limit_param),
+          append(append_param), partition_map_path(partition_map_param),
+          dry_run(dry_run_param), timers(thread_count_param),
+          progress_json_path(progress_json_param), progress_interval(progress_interval_param),
+          flush_rows(flush_rows_param > 0 ? flush_rows_param : batch_size_param),
+          flush_ms(flush_ms_param),
+          backend(backend_param ? std::move(backend_param) : std::make_unique<TaosWriteBackend>()) {
+        
+        // 试运行：除服务端调用外全部照常执行；不写检查点，也不覆盖分区表和映射表
+        if (dry_run) {
+            backend = std::make_unique<NullWriteBackend>();
+            checkpoint_enabled = false;
+        }
+        
+        // vgroup 布局从已建子表的元数据读取，因此路由模式需要预建表阶段
+        if (vgroup_routing) {
+            precreate_tables = true;
+        }
+        
+        if (checkpoint_path.empty()) {
+            checkpoint_path = "output/checkpoints/" + db_name + ".ckpt";
+        }
+        if (partition_map_path.empty()) {
+            partition_map_path = "output/query_results/healpix_partition_map.csv";
+        }
+        if (dead_letter_path.empty()) {
+            auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+            std::stringstream ts;
+            ts << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S");
+            dead_letter_path = "output/dead_letter/" + db_name + "_" + ts.str() + ".dlq";
+        }
+        dead_letter = std::make_unique<DeadLetterWriter>(dead_letter_path);
+        
+        // 初始化 HealPix
+        healpix_base = std::make_unique<Healpix_Base>(nside_base, NEST, SET_NSIDE);
+        healpix_fine = std::make_unique<Healpix_Base>(nside_fine, NEST, SET_NSIDE);
+        std::cout << "✅ HealPix 初始化成功，基础NSIDE=" << nside_base 
+                 << "，细分NSIDE=" << nside_fine << std::endl;
+        
+        // 初始化 TDengine
+        taos_init();
+        
+        // 连接数据库
+        conn = backend->connect(host, user, password, port);
+        if (conn == nullptr) {
+            throw std::runtime_error("无法连接到 TDengine: " + std::string(taos_errstr(conn)));
+        }
+        if (backend->isServer()) {
+            std::cout << "✅ TDengine 连接成功" << std::endl;
+        } else {
+            std::cout << "🧪 写入后端: " << backend->name() << "（不连接 TDengine）" << std::endl;
+        }
+    }
+    
+    ~TDengineHealpixImporter() {
+        // 连接池需在 taos_cleanup 之前关闭
+        conn_pool.reset();
+        if (conn) {
+            backend->close(conn);
+        }
+        taos_cleanup();
+    }
+    
+    bool dropDatabase() {
+        std::cout << "⚠️ 正在删除数据库: " << db_name << std::endl;
+        
+        std::string sql = "DROP DATABASE IF EXISTS " + db_name;
+        int code = 0;
+        std::string message;
+        if (!backend->execute(conn, sql, code, message)) {
+            std::cerr << "❌ 删除数据库失败: " << message << std::endl;
+            return false;
+        }
+        
+        std::cout << "✅ 数据库 " << db_name << " 已删除" << std::endl;
+        return true;
+    }
+    
+    bool createSuperTable() {
+        std::cout << "🏗️ 创建数据库和超级表..." << std::endl;
+        
+        // 创建数据库
+        std::string create_db_sql = "CREATE DATABASE IF NOT EXISTS " + db_name;
+        int code = 0;
+        std::string message;
+        if (!backend->execute(conn, create_db_sql, code, message)) {
+            std::cerr << "❌ 创建数据库失败: " << message << std::endl;
+            return false;
+        }
+        
+        // 使用数据库
+        std::string use_db_sql = "USE " + db_name;
+        if (!backend->execute(conn, use_db_sql, code, message)) {
+            std::cerr << "❌ 使用数据库失败: " << message << std::endl;
+            return false;
+        }
+        
+        // 创建超级表
+        std::string create_table_sql = 
+            "CREATE STABLE IF NOT EXISTS " + table_name + " ("
+            "ts TIMESTAMP, "
+            "ra DOUBLE, "
+            "dec DOUBLE, "
+            "mag DOUBLE, "
+            "jd_tcb DOUBLE"
+            ") TAGS (healpix_id BIGINT, source_id BIGINT)";
+        
+        if (!backend->execute(conn, create_table_sql, code, message)) {
+            std::cerr << "❌ 创建超级表失败: " << message << std::endl;
+            return false;
+        }
+        
+        std::cout << "✅ 超级表 " << table_name << " 已创建" << std::endl;
+        
+        // 数据库已存在后再初始化连接池，池中连接的 USE 才能成功
+        if (!conn_pool) {
+            conn_pool = std::make_unique<TDengineConnectionPool>(*backend, host, user, password, db_name, port,
+                                                                 pool_min, pool_max);
+        }
+        return true;
+    }
+    
+    // 简化的自适应HealPix ID计算
+    struct PartitionEntry {
+        long count;      // 该基础区块累计导入的记录数
+        bool refined;    // 是否使用细分分辨率（首次出现时决定，之后冻结）
+    };
+    
+    // 读取分区表；文件头记录分区参数，与当前参数不一致时拒绝沿用
+    bool loadPartitionMap(const std::string& path, std::map<long, PartitionEntry>& partition_map) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cout << "⚠️ 未找到分区表 " << path << "，按本次数据决定细分" << std::endl;
+            return false;
+        }
+        std::string line;
+        std::getline(file, line);
+        int file_base = 0, file_fine = 0, file_threshold = 0;
+        if (std::sscanf(line.c_str(), "# nside_base=%d nside_fine=%d count_threshold=%d",
+                        &file_base, &file_fine, &file_threshold) != 3) {
+            throw std::runtime_error("分区表格式无效: " + path);
+        }
+        if (file_base != nside_base || file_fine != nside_fine) {
+            throw std::runtime_error("分区表参数不一致: " + path + " 使用 nside_base=" +
+                                     std::to_string(file_base) + " nside_fine=" + std::to_string(file_fine));
+        }
+        std::getline(file, line);  // 列名
+        while (std::getline(file, line)) {
+            long base_id = 0, count = 0;
+            int refined = 0;
+            if (std::sscanf(line.c_str(), "%ld,%ld,%d", &base_id, &count, &refined) == 3) {
+                partition_map[base_id] = PartitionEntry{count, refined != 0};
+            }
+        }
+        std::cout << "📥 已加载分区表: " << partition_map.size() << " 个基础区块" << std::endl;
+        return true;
+    }
+    
+    void savePartitionMap(const std::string& path, const std::map<long, PartitionEntry>& partition_map) {
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) {
+            std::filesystem::create_directories(parent);
+        }
+        std::string tmp_path = path + ".tmp";
+        std::ofstream file(tmp_path);
+        if (!file.is_open()) {
+            std::cerr << "⚠️ 无法写入分区表: " << path << std::endl;
+            return;
+        }
+        file << "# nside_base=" << nside_base << " nside_fine=" << nside_fine
+             << " count_threshold=" << count_threshold << "\n";
+        file << "base_id,count,refined\n";
+        for (const auto& pair : partition_map) {
+            file << pair.first << "," << pair.second.count << "," << (pair.second.refined ? 1 : 0) << "\n";
+        }
+        file.close();
+        std::filesystem::rename(tmp_path, path);
+        std::cout << "💾 已保存分区表: " << path << " (" << partition_map.size() << " 个基础区块)" << std::endl;
+    }
+    
+    void loadSourceMap(std::map<int, long>& source_healpix_map) {
+        std::ifstream existing_map("output/query_results/sourceid_healpix_map.csv");
+        std::string map_line;
+        std::getline(existing_map, map_line);
+        while (std::getline(existing_map, map_line)) {
+            size_t comma = map_line.find(',');
+            if (comma == std::string::npos) continue;
+            source_healpix_map[std::atoi(map_line.c_str())] = std::atol(map_line.c_str() + comma + 1);
+        }
+    }
+    
+    // 保存映射表
+    void saveSourceMap(const std::map<int, long>& source_healpix_map) {
+        std::filesystem::create_directories("output/query_results");
+        std::ofstream map_file("output/query_results/sourceid_healpix_map.csv");
+        std::ofstream map_file_root("sourceid_healpix_map.csv");
+        
+        if (map_file.is_open() && map_file_root.is_open()) {
+            map_file << "source_id,healpix_id\n";
+            map_file_root << "source_id,healpix_id\n";
+            
+            for (const auto& pair : source_healpix_map) {
+                map_file << pair.first << "," << pair.second << "\n";
+                map_file_root << pair.first << "," << pair.second << "\n";
+            }
+            
+            map_file.close();
+            map_file_root.close();
+            std::cout << "💾 已保存映射表，共 " << source_healpix_map.size() << " 条记录" << std::endl;
+        }
+    }
+    
+    // 保存源位置索引（查询端两阶段锥形检索使用）
+    void saveSourceIndex(const SourceIndexBuilder& builder, const std::string& path) {
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        if (builder.save(path, nside_base, nside_fine)) {
+            std::cout << "💾 已保存源位置索引: " << path << " (" << builder.size() << " 个源)" << std::endl;
+        } else {
+            std::cerr << "⚠️ 源位置索引写入失败: " << path << std::endl;
+        }
+    }
+    
+    // importData 完成后发布本次写入的源位置索引；追加模式并入已有索引，未完成的导入不发布
+    void publishSourceIndex(SourceIndexBuilder& builder) {
+        if (dry_run) return;
+        if (!last_completed) {
+            std::cerr << "⚠️ 导入未完成，源位置索引未更新" << std::endl;
+            return;
+        }
+        if (append) {
+            mergeSourceIndex(builder, source_index_path);
+        }
+        saveSourceIndex(builder, source_index_path);
+    }
+    
+    // 追加模式下并入已有索引
+    void mergeSourceIndex(SourceIndexBuilder& builder, const std::string& path) {
+        if (!std::filesystem::exists(path)) return;
+        std::string error;
+        if (!builder.merge(path, error)) {
+            std::cerr << "⚠️ " << error << "，将重建索引" << std::endl;
+        }
+    }
+    
+    long calculateAdaptiveHealpixId(double ra, double dec, int source_id, 
+                                   const std::unordered_set<long>& refined_bases,
+                                   long* base_out = nullptr) {
+        // 验证和裁剪坐标值到有效范围
+        ra = fmod(ra, 360.0);
+        if (ra < 0) ra += 360.0;  // 确保 RA 在 [0, 360) 范围内
+        
+        dec = std::max(-90.0, std::min(90.0, dec));  // 裁剪 DEC 到 [-90, 90] 范围
         
-        if (count > count_threshold) {
+        // 计算基础分辨率的 healpix ID
+        pointing pt(deg2rad(90.0 - dec), deg2rad(ra));
+        long base_id = healpix_base->ang2pix(pt);
+        if (base_out) *base_out = base_id;
+        
+        // 检查是否需要细分
+        if (refined_bases.count(base_id)) {
             // 需要细分，使用细分分辨率
             long fine_id = healpix_fine->ang2pix(pt);
             return (base_id << 32) + fine_id;  // 组合ID
@@ -334,6 +2209,27 @@ public:
         }
     }
     
+    // 解析一行 CSV: timestamp,source_id,ra,dec,mag,jd_tcb；字段不足返回 false，数值非法时抛出异常
+    static bool parseCsvRecord(const std::string& line, AstronomicalRecord& record) {
+        std::stringstream ss(line);
+        std::string item;
+        std::vector<std::string> fields;
+        
+        while (std::getline(ss, item, ',')) {
+            fields.push_back(item);
+        }
+        
+        if (fields.size() < 6) return false;
+        record.timestamp = fields[0];
+        record.source_id = std::stoi(fields[1]);
+        record.ra = std::stod(fields[2]);
+        record.dec = std::stod(fields[3]);
+        record.mag = std::stod(fields[4]);
+        record.jd_tcb = std::stod(fields[5]);
+        record.ts_ms = parseTimestampMs(record.timestamp);
+        return true;
+    }
+    
     std::vector<AstronomicalRecord> loadAndProcessData(const std::string& csv_file) {
         std::cout << "📖 读取和处理数据文件: " << csv_file << std::endl;
         
@@ -342,39 +2238,50 @@ public:
             throw std::runtime_error("无法打开数据文件: " + csv_file);
         }
         
+        // 检查点指纹：输入文件大小、修改时间、分区参数与导入模式
+        uint64_t fingerprint = 1469598103934665603ULL;  // FNV-1a
+        auto mix = [&fingerprint](uint64_t value) {
+            for (int b = 0; b < 8; ++b) {
+                fingerprint ^= (value >> (b * 8)) & 0xff;
+                fingerprint *= 1099511628211ULL;
+            }
+        };
+        mix(std::filesystem::file_size(csv_file));
+        mix(static_cast<uint64_t>(std::filesystem::last_write_time(csv_file).time_since_epoch().count()));
+        mix(nside_base);
+        mix(nside_fine);
+        mix(count_threshold);
+        mix(static_cast<uint64_t>(batch_size) * SPLIT_BATCHES);
+        mix(append ? 1 : 0);
+        input_fingerprint = fingerprint;
+        
         std::vector<AstronomicalRecord> records;
         std::string line;
         
         // 跳过头部
         std::getline(file, line);
         
+        auto read_mark = StageTimers::Clock::now();
+        StageTimers::Clock::duration read_time{}, parse_time{};
         while (std::getline(file, line)) {
-            std::stringstream ss(line);
-            std::string item;
-            std::vector<std::string> fields;
-            
-            while (std::getline(ss, item, ',')) {
-                fields.push_back(item);
-            }
-            
-            if (fields.size() >= 6) {
-                AstronomicalRecord record;
-                record.timestamp = fields[0];
-                record.source_id = std::stoi(fields[1]);
-                record.ra = std::stod(fields[2]);
-                record.dec = std::stod(fields[3]);
-                record.mag = std::stod(fields[4]);
-                record.jd_tcb = std::stod(fields[5]);
-                
+            auto parse_mark = StageTimers::Clock::now();
+            read_time += parse_mark - read_mark;
+            AstronomicalRecord record;
+            if (parseCsvRecord(line, record)) {
                 records.push_back(record);
             }
+            read_mark = StageTimers::Clock::now();
+            parse_time += read_mark - parse_mark;
         }
+        timers.add(Stage::READ, read_time);
+        timers.add(Stage::PARSE, parse_time);
         
         std::cout << "✅ 成功读取 " << records.size() << " 条记录" << std::endl;
         
         // 统计每个基础healpix区块的天体数量
         std::cout << "🔧 开始自适应 healpix 分区计算..." << std::endl;
         std::map<long, int> base_counts;
+        auto count_start = StageTimers::Clock::now();
         
         for (const auto& record : records) {
             // 验证和裁剪坐标值
@@ -387,231 +2294,1351 @@ public:
             base_counts[base_id]++;
         }
         
-        std::cout << "📊 基础分区统计:" << std::endl;
-        std::cout << "   - 总区块数: " << base_counts.size() << std::endl;
+        std::cout << "📊 基础分区统计:" << std::endl;
+        std::cout << "   - 总区块数: " << base_counts.size() << std::endl;
+        
+        // 计算平均值和最大值
+        long total_count = 0;
+        int max_count = 0;
+        for (const auto& pair : base_counts) {
+            total_count += pair.second;
+            max_count = std::max(max_count, pair.second);
+        }
+        double avg_count = static_cast<double>(total_count) / base_counts.size();
+        std::cout << "   - 平均天体/区块: " << std::fixed << std::setprecision(1) << avg_count << std::endl;
+        std::cout << "   - 最大天体/区块: " << max_count << std::endl;
+        
+        // 统计需要细分的区块
+        int large_blocks = 0;
+        for (const auto& pair : base_counts) {
+            if (pair.second > count_threshold) {
+                large_blocks++;
+            }
+        }
+        std::cout << "⚡ 需要细分的区块: " << large_blocks << " 个" << std::endl;
+        
+        // 细分决策：追加模式沿用已持久化的分区表，只有新出现的基础区块按本次计数决定
+        std::map<long, PartitionEntry> partition_map;
+        bool map_loaded = append && loadPartitionMap(partition_map_path, partition_map);
+        int frozen_blocks = 0;
+        int new_blocks = 0;
+        for (const auto& pair : base_counts) {
+            auto it = partition_map.find(pair.first);
+            if (map_loaded && it != partition_map.end()) {
+                it->second.count += pair.second;
+                if (!it->second.refined && it->second.count > count_threshold) frozen_blocks++;
+            } else {
+                partition_map[pair.first] = PartitionEntry{pair.second, pair.second > count_threshold};
+                new_blocks++;
+            }
+        }
+        std::unordered_set<long> refined_bases;
+        for (const auto& pair : partition_map) {
+            if (pair.second.refined) refined_bases.insert(pair.first);
+        }
+        if (map_loaded) {
+            std::cout << "🧊 沿用分区决策: " << partition_map_path << "，新增基础区块 " << new_blocks << " 个";
+            if (frozen_blocks > 0) {
+                std::cout << "，" << frozen_blocks << " 个区块累计超过阈值但保持不细分（需重建库才能重新分区）";
+            }
+            std::cout << std::endl;
+        }
+        if (!dry_run) {
+            savePartitionMap(partition_map_path, partition_map);
+        }
+        timers.add(Stage::COUNT, StageTimers::Clock::now() - count_start);
+        
+        // 为每条记录分配healpix_id
+        {
+            StageTimers::Scope scope(timers, Stage::PIXELIZE);
+            for (auto& record : records) {
+                record.healpix_id = calculateAdaptiveHealpixId(record.ra, record.dec, record.source_id, refined_bases);
+            }
+        }
+        
+        // 生成映射表（追加模式合并已有映射，已导入的源保持原 healpix_id）
+        std::map<int, long> source_healpix_map;
+        if (append) {
+            loadSourceMap(source_healpix_map);
+        }
+        for (const auto& record : records) {
+            if (source_healpix_map.find(record.source_id) == source_healpix_map.end()) {
+                source_healpix_map[record.source_id] = record.healpix_id;
+            }
+        }
+        if (!dry_run) {
+            saveSourceMap(source_healpix_map);
+        }
+        
+        return records;
+    }
+
+    // 组内按时间排序并合并重复时间戳
+    // ordered 已按 (healpix_id, source_id) 排好；各分组由线程通过原子游标领取，组内有逆序才排序；
+    // 同一时间戳保留最后出现的记录（与 TDengine 同时间戳覆盖写的结果一致），被合并的位置置空后统一压缩
+    void orderGroups(std::vector<const AstronomicalRecord*>& ordered) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<size_t> bounds;
+        for (size_t i = 0; i < ordered.size(); ++i) {
+            if (i == 0 || ordered[i]->healpix_id != ordered[i - 1]->healpix_id ||
+                ordered[i]->source_id != ordered[i - 1]->source_id) {
+                bounds.push_back(i);
+            }
+        }
+        bounds.push_back(ordered.size());
+        size_t group_total = bounds.size() - 1;
+        
+        std::atomic<size_t> next_group{0};
+        std::atomic<size_t> reordered_groups{0}, out_of_order_rows{0}, duplicate_rows{0};
+        auto sort_groups = [&]() {
+            size_t local_groups = 0, local_inversions = 0, local_duplicates = 0;
+            while (true) {
+                size_t g = next_group.fetch_add(1, std::memory_order_relaxed);
+                if (g >= group_total) break;
+                auto first = ordered.begin() + bounds[g];
+                auto last = ordered.begin() + bounds[g + 1];
+                
+                size_t inversions = 0;
+                for (auto it = first + 1; it < last; ++it) {
+                    if ((*it)->ts_ms < (*(it - 1))->ts_ms) inversions++;
+                }
+                if (inversions > 0) {
+                    std::stable_sort(first, last, [](const AstronomicalRecord* a, const AstronomicalRecord* b) {
+                        return a->ts_ms < b->ts_ms;
+                    });
+                    local_groups++;
+                    local_inversions += inversions;
+                }
+                
+                // 无法解析的时间戳不参与去重
+                for (auto prev = first, it = first + 1; it < last; prev = it, ++it) {
+                    if ((*it)->ts_ms == (*prev)->ts_ms && (*it)->ts_ms != std::numeric_limits<int64_t>::min()) {
+                        *prev = nullptr;
+                        local_duplicates++;
+                    }
+                }
+            }
+            reordered_groups += local_groups;
+            out_of_order_rows += local_inversions;
+            duplicate_rows += local_duplicates;
+        };
+        
+        std::vector<std::thread> sorters;
+        int sorter_count = std::max(1, std::min<int>(thread_count, static_cast<int>(group_total)));
+        for (int i = 0; i < sorter_count; ++i) {
+            sorters.emplace_back(sort_groups);
+        }
+        for (auto& sorter : sorters) {
+            sorter.join();
+        }
+        if (duplicate_rows > 0) {
+            ordered.erase(std::remove(ordered.begin(), ordered.end(), nullptr), ordered.end());
+        }
+        
+        ordering.groups = group_total;
+        ordering.reordered_groups = reordered_groups;
+        ordering.out_of_order_rows = out_of_order_rows;
+        ordering.duplicate_rows = duplicate_rows;
+        ordering.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        
+        size_t total_rows = ordered.size() + ordering.duplicate_rows;
+        std::cout << "🕒 组内时间排序: 乱序记录 " << ordering.out_of_order_rows << " 条 ("
+                 << std::fixed << std::setprecision(2)
+                 << (total_rows > 0 ? ordering.out_of_order_rows * 100.0 / total_rows : 0.0) << "%)，涉及子表 "
+                 << ordering.reordered_groups << "/" << ordering.groups << " 个；合并重复时间戳 "
+                 << ordering.duplicate_rows << " 条 (耗时 " << ordering.seconds << " 秒)" << std::endl;
+    }
+    
+    // 多线程工作函数
+    void workerThread(int worker_id, const std::vector<ImportTask>& tasks,
+                     std::vector<std::unique_ptr<TaskShard>>& shards,
+                     ThreadSafeStats& stats) {
+        
+        bindWorkerSlot(worker_id);
+        size_t home_shard = static_cast<size_t>(worker_id) % shards.size();
+        std::vector<const ImportTask*> coalesced;
+        
+        while (true) {
+            // 自适应模式下超出活跃线程数的线程在此等待
+            controller->waitForSlot(worker_id);
+            if (abort_import.load(std::memory_order_relaxed)) {
+                controller->finish();
+                break;
+            }
+            
+            // 先从本分片的原子游标领取任务，取空后依次窃取其他分片
+            const ImportTask* task = nullptr;
+            TaskShard* shard = nullptr;
+            for (size_t k = 0; k < shards.size() && !task; ++k) {
+                TaskShard& candidate = *shards[(home_shard + k) % shards.size()];
+                size_t pos = candidate.cursor.fetch_add(1, std::memory_order_relaxed);
+                if (pos < candidate.task_indices.size()) {
+                    task = &tasks[candidate.task_indices[pos]];
+                    shard = &candidate;
+                }
+            }
+            if (!task) {
+                controller->finish();
+                break;
+            }
+            
+            // 执行任务；已知 vgroup 的小任务与同分片后续任务合并为一条多表 INSERT
+            int finished_tasks = 1;
+            long claimed_rows = static_cast<long>(task->count);
+            stats.addInFlight(claimed_rows);
+            size_t batch_rows = static_cast<size_t>(controller->batchSize());
+            if (shard->vgroup >= 0 && !task->create_table && task->count < batch_rows) {
+                coalesced.assign(1, task);
+                size_t rows = task->count;
+                while (rows < batch_rows) {
+                    size_t pos = shard->cursor.fetch_add(1, std::memory_order_relaxed);
+                    if (pos >= shard->task_indices.size()) break;
+                    const ImportTask* next = &tasks[shard->task_indices[pos]];
+                    claimed_rows += static_cast<long>(next->count);
+                    stats.addInFlight(static_cast<long>(next->count));
+                    if (next->create_table) {
+                        processImportTask(*next, stats, shard->vgroup);
+                    } else {
+                        coalesced.push_back(next);
+                        rows += next->count;
+                    }
+                    finished_tasks++;
+                }
+                processCoalescedTasks(coalesced, stats, shard->vgroup);
+            } else {
+                processImportTask(*task, stats, shard->vgroup);
+            }
+            
+            // 更新进度（由进度上报线程采样输出）
+            stats.addInFlight(-claimed_rows);
+            stats.incrementGroup(finished_tasks);
+        }
+    }
+
+    std::string subTableName(long healpix_id, int source_id) const {
+        return table_name + "_" + std::to_string(healpix_id) + "_" + std::to_string(source_id);
+    }
+    
+    // "IF NOT EXISTS <子表> USING <超级表> TAGS (...)" 片段，可拼接成多表建表语句
+    std::string subTableClause(long healpix_id, int source_id) const {
+        return "IF NOT EXISTS " + subTableName(healpix_id, source_id) + " USING " + table_name +
+               " TAGS (" + std::to_string(healpix_id) + ", " + std::to_string(source_id) + ")";
+    }
+    
+    // 预建表阶段：多线程并发执行多表 CREATE TABLE 语句，返回每个子表是否已建好
+    std::vector<char> precreateSubTables(const std::vector<std::pair<long, int>>& all_keys,
+                                         const std::vector<size_t>& needed) {
+        std::vector<std::pair<long, int>> table_keys;
+        table_keys.reserve(needed.size());
+        for (size_t index : needed) {
+            table_keys.push_back(all_keys[index]);
+        }
+        
+        std::vector<char> created(table_keys.size(), 0);
+        std::atomic<size_t> next_table{0};
+        std::atomic<int> failed_statements{0};
+        size_t per_statement = static_cast<size_t>(std::max(1, create_batch));
+        
+        auto creator = [&]() {
+            TAOS* create_conn = acquireConnection();
+            while (true) {
+                size_t begin = next_table.fetch_add(per_statement, std::memory_order_relaxed);
+                if (begin >= table_keys.size()) break;
+                size_t end = std::min(begin + per_statement, table_keys.size());
+                
+                // 按子表数和 SQL 长度双重限制拼接语句
+                size_t stmt_begin = begin;
+                while (stmt_begin < end) {
+                    std::string sql = "CREATE TABLE";
+                    size_t stmt_end = stmt_begin;
+                    while (stmt_end < end && (stmt_end == stmt_begin || sql.size() < max_sql_bytes * 9 / 10)) {
+                        sql += " " + subTableClause(table_keys[stmt_end].first, table_keys[stmt_end].second);
+                        ++stmt_end;
+                    }
+                    
+                    int code = 0;
+                    std::string message;
+                    bool ok = false;
+                    {
+                        StageTimers::Scope scope(timers, Stage::CREATE_TABLES);
+                        ok = backend->execute(create_conn, sql, code, message);
+                    }
+                    if (ok) {
+                        std::fill(created.begin() + stmt_begin, created.begin() + stmt_end, 1);
+                    } else {
+                        failed_statements++;
+                    }
+                    stmt_begin = stmt_end;
+                }
+            }
+            conn_pool->returnConnection(create_conn);
+        };
+        
+        std::vector<std::thread> creators;
+        for (int i = 0; i < thread_count; ++i) {
+            creators.emplace_back(creator);
+        }
+        for (auto& t : creators) {
+            t.join();
+        }
+        
+        size_t ok_count = std::count(created.begin(), created.end(), 1);
+        std::cout << "✅ 预建子表完成: " << ok_count << "/" << table_keys.size();
+        if (failed_statements > 0) {
+            std::cout << "，失败语句 " << failed_statements << " 条（相关子表在导入阶段单独创建）";
+        }
+        std::cout << std::endl;
+        
+        // 映射回完整分组列表
+        std::vector<char> created_all(all_keys.size(), 0);
+        for (size_t i = 0; i < needed.size(); ++i) {
+            created_all[needed[i]] = created[i];
+        }
+        return created_all;
+    }
+    
+    // 取连接与限速等待都记入等待阶段
+    TAOS* acquireConnection(int vgroup = -1) {
+        StageTimers::Scope scope(timers, Stage::NETWORK_WAIT);
+        return conn_pool->getConnection(vgroup);
+    }
+    
+    void throttle(size_t rows, size_t bytes) {
+        StageTimers::Scope scope(timers, Stage::NETWORK_WAIT);
+        limiter.acquire(rows, bytes);
+    }
+    
+    // 执行写入语句；可重试错误按指数退避重试，每次重试换用连接池中的另一条连接
+    // 服务端往返计入 stage（建表或提交），退避与重新取连接计入等待阶段
+    // 重新取连接时沿用任务的 vgroup 亲和；放弃时若最后一次是连接错误，也把坏连接换掉再交还调用方
+    bool executeWithRetry(TAOS*& task_conn, int vgroup, const std::string& sql, ThreadSafeStats& stats,
+                          int& error_code, std::string& error_message, Stage stage = Stage::COMMIT) {
+        for (int attempt = 0;; ++attempt) {
+            {
+                StageTimers::Scope scope(timers, stage);
+                if (backend->execute(task_conn, sql, error_code, error_message)) {
+                    return true;
+                }
+            }
+            
+            bool broken = isConnectionError(error_message);
+            if (attempt >= retry_times ||
+                classifyWriteError(error_code, error_message) == WriteErrorClass::PERMANENT) {
+                if (broken) {
+                    conn_pool->returnConnection(task_conn, false);
+                    task_conn = acquireConnection(vgroup);
+                }
+                return false;
+            }
+            stats.addRetry();
+            conn_pool->returnConnection(task_conn, !broken);
+            {
+                StageTimers::Scope scope(timers, Stage::NETWORK_WAIT);
+                std::this_thread::sleep_for(retryBackoff(attempt));
+            }
+            task_conn = acquireConnection(vgroup);
+        }
+    }
+    
+    // 追加任务中 [begin, end) 区间记录的 VALUES 元组
+    static void appendValues(std::ostringstream& sql, const ImportTask& task, size_t begin, size_t end) {
+        for (size_t j = begin; j < end; ++j) {
+            if (j > begin) sql << ",";
+            const auto& record = *task.records[j];
+            sql << "('" << record.timestamp << "'," 
+                << std::fixed << std::setprecision(6) << record.ra << ","
+                << std::fixed << std::setprecision(6) << record.dec << ","
+                << std::fixed << std::setprecision(2) << record.mag << ","
+                << std::fixed << std::setprecision(6) << record.jd_tcb << ")";
+        }
+    }
+    
+    // 从 information_schema 一次性读取超级表下全部子表及其所在 vgroup
+    // TDengine 按库名+表名哈希把子表分配到 vgroup，直接读元数据可避免在客户端复现哈希与区间划分
+    std::unordered_map<std::string, int> loadSubtableCatalog() {
+        std::unordered_map<std::string, int> layout;
+        if (!backend->isServer()) return layout;
+        std::string sql = "SELECT table_name, vgroup_id FROM information_schema.ins_tables WHERE db_name = '" +
+                          db_name + "' AND stable_name = '" + table_name + "'";
+        TAOS_RES* result = taos_query(conn, sql.c_str());
+        if (taos_errno(result) != 0) {
+            std::cerr << "⚠️ 读取子表目录失败: " << taos_errstr(result) << std::endl;
+            taos_free_result(result);
+            return layout;
+        }
+        TAOS_ROW row;
+        while ((row = taos_fetch_row(result)) != nullptr) {
+            if (row[0] == nullptr || row[1] == nullptr) continue;
+            int* lengths = taos_fetch_lengths(result);
+            layout[std::string(static_cast<const char*>(row[0]), lengths[0])] = *static_cast<int32_t*>(row[1]);
+        }
+        taos_free_result(result);
+        return layout;
+    }
+    
+    // 同一 vgroup 的多个小任务合并写入：INSERT INTO t1 VALUES (...) t2 VALUES (...) ...
+    void processCoalescedTasks(const std::vector<const ImportTask*>& batch, ThreadSafeStats& stats, int vgroup) {
+        TAOS* task_conn = acquireConnection(vgroup);
+        int error_code = 0;
+        std::string error_message;
+        
+        auto build_start = StageTimers::Clock::now();
+        std::ostringstream insert_sql;
+        insert_sql << "INSERT INTO";
+        size_t rows = 0;
+        for (const ImportTask* task : batch) {
+            insert_sql << " " << subTableName(task->healpix_id, task->source_id) << " VALUES ";
+            appendValues(insert_sql, *task, 0, task->count);
+            rows += task->count;
+        }
+        std::string sql = insert_sql.str();
+        timers.add(Stage::BUILD_SQL, StageTimers::Clock::now() - build_start);
+        
+        throttle(rows, sql.size());
+        auto batch_start = std::chrono::high_resolution_clock::now();
+        bool ok = executeWithRetry(task_conn, vgroup, sql, stats, error_code, error_message);
+        double latency_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - batch_start).count();
+        controller->recordBatch(static_cast<int>(rows), sql.size(), latency_ms, ok);
+        
+        if (ok) {
+            stats.addSuccess(rows);
+            for (const ImportTask* task : batch) {
+                if (journal) journal->markDone(task->healpix_id, task->source_id, task->chunk);
+            }
+        } else {
+            for (const ImportTask* task : batch) {
+                dead_letter->write(task->healpix_id, task->source_id, error_code, error_message,
+                                   task->records, task->count);
+            }
+            stats.addDeadLetter(rows);
+            stats.addError(rows);
+        }
+        conn_pool->returnConnection(task_conn);
+    }
+    
+    // 处理单个导入任务
+    void processImportTask(const ImportTask& task, ThreadSafeStats& stats, int vgroup = -1) {
+        TAOS* task_conn = acquireConnection(vgroup);
+        int error_code = 0;
+        std::string error_message;
+        
+        try {
+            std::string table_name_full = subTableName(task.healpix_id, task.source_id);
+            
+            // 创建子表（预建表阶段已完成时跳过）
+            if (task.create_table) {
+                std::string create_sql = "CREATE TABLE " + subTableClause(task.healpix_id, task.source_id);
+                if (!executeWithRetry(task_conn, vgroup, create_sql, stats, error_code, error_message, Stage::CREATE_TABLES)) {
+                    dead_letter->write(task.healpix_id, task.source_id, error_code, error_message,
+                                       task.records, task.count);
+                    stats.addDeadLetter(task.count);
+                    conn_pool->returnConnection(task_conn);
+                    stats.addError(task.count);
+                    return;
+                }
+            }
+            
+            // 批量插入数据（批大小由控制器给出，每批重新读取）
+            bool task_ok = true;
+            size_t step = 0;
+            for (size_t i = 0; i < task.count; i += step) {
+                step = static_cast<size_t>(controller->batchSize());
+                size_t end_idx = std::min(i + step, task.count);
+                
+                auto build_start = StageTimers::Clock::now();
+                std::ostringstream insert_sql;
+                insert_sql << "INSERT INTO " << table_name_full << " VALUES ";
+                appendValues(insert_sql, task, i, end_idx);
+                std::string sql = insert_sql.str();
+                timers.add(Stage::BUILD_SQL, StageTimers::Clock::now() - build_start);
+                
+                throttle(end_idx - i, sql.size());
+                auto batch_start = std::chrono::high_resolution_clock::now();
+                bool ok = executeWithRetry(task_conn, vgroup, sql, stats, error_code, error_message);
+                double latency_ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::high_resolution_clock::now() - batch_start).count();
+                if (ok) {
+                    stats.addSuccess(end_idx - i);
+                } else {
+                    dead_letter->write(task.healpix_id, task.source_id, error_code, error_message,
+                                       task.records + i, end_idx - i);
+                    stats.addDeadLetter(end_idx - i);
+                    stats.addError(end_idx - i);
+                    task_ok = false;
+                }
+                controller->recordBatch(static_cast<int>(end_idx - i), sql.size(), latency_ms, ok);
+            }
+            
+            // 整个任务写入成功后记入检查点
+            if (task_ok && journal) {
+                journal->markDone(task.healpix_id, task.source_id, task.chunk);
+            }
+            
+        } catch (...) {
+            stats.addError(task.count);
+        }
+        
+        conn_pool->returnConnection(task_conn);
+    }
+    
+    // 重放死信文件：记录已带 healpix_id，直接走分组导入流程，不写检查点
+    bool replayDeadLetter(const std::string& path) {
+        std::vector<AstronomicalRecord> records;
+        std::string error;
+        if (!DeadLetterWriter::read(path, records, error)) {
+            std::cerr << "❌ " << error << std::endl;
+            return false;
+        }
+        std::cout << "📮 从死信文件读取 " << records.size() << " 条记录: " << path << std::endl;
+        checkpoint_enabled = false;
+        return importData(records);
+    }
+    
+    // 协调者：基于完整输入计算分区表，按行对齐的字节区间切分工作单元并写出作业目录
+    bool coordinate(const std::string& input, const std::string& job_dir, int unit_count) {
+        ImportJobDirectory job(job_dir);
+        job.create();
+        std::cout << "\n🧭 协调者: 统计基础分区并切分 " << unit_count << " 个工作单元 -> " << job_dir << std::endl;
+        
+        std::ifstream file(input, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "❌ 无法打开数据文件: " << input << std::endl;
+            return false;
+        }
+        std::string line;
+        std::getline(file, line);
+        uint64_t data_begin = static_cast<uint64_t>(file.tellg());
+        
+        // 单遍统计基础区块计数，细分决策与单进程导入一致
+        std::map<long, int> base_counts;
+        std::unordered_set<long> no_refine;
+        long rows = 0;
+        while (std::getline(file, line)) {
+            AstronomicalRecord record;
+            try {
+                if (!parseCsvRecord(line, record)) continue;
+            } catch (...) {
+                continue;
+            }
+            long base_id = 0;
+            calculateAdaptiveHealpixId(record.ra, record.dec, record.source_id, no_refine, &base_id);
+            base_counts[base_id]++;
+            rows++;
+        }
+        std::map<long, PartitionEntry> partition_map;
+        int refined = 0;
+        for (const auto& pair : base_counts) {
+            partition_map[pair.first] = PartitionEntry{pair.second, pair.second > count_threshold};
+            if (pair.second > count_threshold) refined++;
+        }
+        savePartitionMap(job.partitionMapPath(), partition_map);
+        
+        // 切分：每个边界对齐到下一行行首
+        ImportJobDirectory::Manifest manifest;
+        manifest.input = std::filesystem::absolute(input).string();
+        manifest.input_size = std::filesystem::file_size(input);
+        manifest.input_mtime = static_cast<int64_t>(std::filesystem::last_write_time(input).time_since_epoch().count());
+        manifest.nside_base = nside_base;
+        manifest.nside_fine = nside_fine;
+        manifest.count_threshold = count_threshold;
         
-        // 计算平均值和最大值
-        long total_count = 0;
-        int max_count = 0;
-        for (const auto& pair : base_counts) {
-            total_count += pair.second;
-            max_count = std::max(max_count, pair.second);
+        file.clear();
+        std::vector<uint64_t> bounds{data_begin};
+        uint64_t span = (manifest.input_size - data_begin) / std::max(1, unit_count);
+        for (int u = 1; u < unit_count; ++u) {
+            uint64_t target = data_begin + span * u;
+            if (target <= bounds.back()) continue;
+            file.seekg(static_cast<std::streamoff>(target - 1));
+            std::getline(file, line);  // 若 target-1 恰为换行符，读到空串后正好停在 target
+            if (!file) break;
+            uint64_t aligned = static_cast<uint64_t>(file.tellg());
+            if (aligned > bounds.back() && aligned < manifest.input_size) bounds.push_back(aligned);
+        }
+        bounds.push_back(manifest.input_size);
+        for (size_t u = 0; u + 1 < bounds.size(); ++u) {
+            manifest.units.push_back({static_cast<int>(u), bounds[u], bounds[u + 1]});
         }
-        double avg_count = static_cast<double>(total_count) / base_counts.size();
-        std::cout << "   - 平均天体/区块: " << std::fixed << std::setprecision(1) << avg_count << std::endl;
-        std::cout << "   - 最大天体/区块: " << max_count << std::endl;
         
-        // 统计需要细分的区块
-        int large_blocks = 0;
-        for (const auto& pair : base_counts) {
-            if (pair.second > count_threshold) {
-                large_blocks++;
+        uint64_t fingerprint = 1469598103934665603ULL;  // FNV-1a
+        for (uint64_t value : {manifest.input_size, static_cast<uint64_t>(manifest.input_mtime),
+                               static_cast<uint64_t>(nside_base), static_cast<uint64_t>(nside_fine),
+                               static_cast<uint64_t>(count_threshold), static_cast<uint64_t>(manifest.units.size())}) {
+            for (int b = 0; b < 8; ++b) {
+                fingerprint ^= (value >> (b * 8)) & 0xff;
+                fingerprint *= 1099511628211ULL;
             }
         }
-        std::cout << "⚡ 需要细分的区块: " << large_blocks << " 个" << std::endl;
-        
-        // 为每条记录分配healpix_id
+        manifest.fingerprint = fingerprint;
+        if (!job.writeManifest(manifest)) {
+            std::cerr << "❌ 无法写入作业目录: " << job_dir << std::endl;
+            return false;
+        }
+        std::cout << "✅ 作业已就绪: " << rows << " 条记录，" << base_counts.size() << " 个基础区块 (细分 "
+                 << refined << " 个)，" << manifest.units.size() << " 个工作单元" << std::endl;
+        return true;
+    }
+    
+    // 读取单元字节区间内的记录，按冻结的分区表分配 healpix_id
+    std::vector<AstronomicalRecord> loadUnit(const std::string& input, const ImportJobDirectory::Unit& unit,
+                                             const std::unordered_set<long>& refined_bases) {
+        std::vector<AstronomicalRecord> records;
+        std::ifstream file(input, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("无法打开数据文件: " + input);
+        }
+        file.seekg(static_cast<std::streamoff>(unit.begin));
+        uint64_t offset = unit.begin;
+        std::string line;
+        {
+            StageTimers::Scope scope(timers, Stage::READ);
+            while (offset < unit.end && std::getline(file, line)) {
+                offset += line.size() + 1;
+                AstronomicalRecord record;
+                try {
+                    if (parseCsvRecord(line, record)) records.push_back(std::move(record));
+                } catch (...) {
+                }
+            }
+        }
+        StageTimers::Scope scope(timers, Stage::PIXELIZE);
         for (auto& record : records) {
-            record.healpix_id = calculateAdaptiveHealpixId(record.ra, record.dec, record.source_id, base_counts);
+            record.healpix_id = calculateAdaptiveHealpixId(record.ra, record.dec, record.source_id, refined_bases);
+        }
+        return records;
+    }
+    
+    // 工作进程：循环抢占单元租约并导入，持有期间后台线程刷新租约；全部单元完成后合并映射表
+    bool runWorker(const std::string& job_dir, int lease_ttl_s) {
+        ImportJobDirectory job(job_dir);
+        ImportJobDirectory::Manifest manifest;
+        std::string error;
+        if (!job.readManifest(manifest, error)) {
+            std::cerr << "❌ " << error << std::endl;
+            return false;
+        }
+        std::error_code ec;
+        if (std::filesystem::file_size(manifest.input, ec) != manifest.input_size || ec ||
+            static_cast<int64_t>(std::filesystem::last_write_time(manifest.input, ec).time_since_epoch().count()) !=
+                manifest.input_mtime) {
+            std::cerr << "❌ 输入文件与作业记录不一致（路径需在各主机上相同且文件未被修改）: " << manifest.input << std::endl;
+            return false;
+        }
+        if (manifest.nside_base != nside_base || manifest.nside_fine != nside_fine) {
+            std::cerr << "❌ 分区参数与作业不一致: nside_base=" << manifest.nside_base
+                     << " nside_fine=" << manifest.nside_fine << std::endl;
+            return false;
         }
         
-        // 生成映射表
-        std::map<int, long> source_healpix_map;
-        for (const auto& record : records) {
-            if (source_healpix_map.find(record.source_id) == source_healpix_map.end()) {
-                source_healpix_map[record.source_id] = record.healpix_id;
-            }
+        std::map<long, PartitionEntry> partition_map;
+        if (!loadPartitionMap(job.partitionMapPath(), partition_map)) return false;
+        std::unordered_set<long> refined_bases;
+        for (const auto& pair : partition_map) {
+            if (pair.second.refined) refined_bases.insert(pair.first);
         }
         
-        // 保存映射表
-        std::filesystem::create_directories("output/query_results");
-        std::ofstream map_file("output/query_results/sourceid_healpix_map.csv");
-        std::ofstream map_file_root("sourceid_healpix_map.csv");
+        std::cout << "\n👷 工作进程 " << job.owner() << " 加入作业 " << job_dir << " ("
+                 << manifest.units.size() << " 个单元，租约 " << lease_ttl_s << " 秒)" << std::endl;
+        std::chrono::seconds ttl(std::max(3, lease_ttl_s));
+        int completed = 0;
+        bool all_ok = true;
         
-        if (map_file.is_open() && map_file_root.is_open()) {
-            map_file << "source_id,healpix_id\n";
-            map_file_root << "source_id,healpix_id\n";
+        // 从随机位置开始扫描，减少多个进程同时争抢同一单元
+        std::mt19937 rng(std::random_device{}());
+        size_t start = std::uniform_int_distribution<size_t>(0, manifest.units.size() - 1)(rng);
+        for (size_t k = 0; k < manifest.units.size(); ++k) {
+            const auto& unit = manifest.units[(start + k) % manifest.units.size()];
+            if (!job.claim(unit.id, ttl)) continue;
             
-            for (const auto& pair : source_healpix_map) {
-                map_file << pair.first << "," << pair.second << "\n";
-                map_file_root << pair.first << "," << pair.second << "\n";
+            std::cout << "\n📦 单元 " << unit.id << ": 字节 [" << unit.begin << ", " << unit.end << ")" << std::endl;
+            auto unit_start = std::chrono::steady_clock::now();
+            
+            std::atomic<bool> holding{true};
+            std::atomic<bool> lease_lost{false};
+            abort_import = false;
+            std::mutex beat_mutex;
+            std::condition_variable beat_cv;
+            std::thread heartbeat([&]() {
+                std::unique_lock<std::mutex> lock(beat_mutex);
+                while (!beat_cv.wait_for(lock, ttl / 3, [&] { return !holding.load(); })) {
+                    if (!job.heartbeat(unit.id)) {
+                        std::cerr << "⚠️ 单元 " << unit.id << " 的租约已被接管，停止写入本单元" << std::endl;
+                        lease_lost = true;
+                        abort_import = true;
+                        return;
+                    }
+                }
+            });
+            
+            bool ok = false;
+            long unit_success = 0, unit_errors = 0;
+            try {
+                auto records = loadUnit(manifest.input, unit, refined_bases);
+                
+                // 单元级检查点：接管他人单元时从断点继续
+                last_success = 0;
+                last_errors = 0;
+                checkpoint_path = job.checkpointPath(unit.id);
+                resume = std::filesystem::exists(checkpoint_path);
+                input_fingerprint = manifest.fingerprint ^ (static_cast<uint64_t>(unit.id) * 0x9E3779B97F4A7C15ULL);
+                // 单元级死信文件：各进程互不覆盖，接管重跑时接着写
+                dead_letter = std::make_unique<DeadLetterWriter>(job.deadLetterPath(unit.id), true);
+                SourceIndexBuilder unit_index;
+                importData(records, &unit_index);
+                ok = last_completed;
+                unit_success = last_success;
+                unit_errors = last_errors;
+                
+                std::map<int, long> unit_sources;
+                for (const auto& record : records) unit_sources.emplace(record.source_id, record.healpix_id);
+                std::ofstream sources(job.sourcesPath(unit.id));
+                sources << "source_id,healpix_id\n";
+                for (const auto& pair : unit_sources) sources << pair.first << "," << pair.second << "\n";
+                if (ok) unit_index.save(job.sourceIndexPath(unit.id), nside_base, nside_fine);
+            } catch (const std::exception& e) {
+                std::cerr << "❌ 单元 " << unit.id << " 导入异常: " << e.what() << std::endl;
             }
             
-            map_file.close();
-            map_file_root.close();
-            std::cout << "💾 已保存映射表，共 " << source_healpix_map.size() << " 条记录" << std::endl;
+            {
+                std::lock_guard<std::mutex> lock(beat_mutex);
+                holding = false;
+            }
+            beat_cv.notify_all();
+            heartbeat.join();
+            dead_letter.reset();  // 关闭本单元的死信文件
+            
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - unit_start).count();
+            if (lease_lost) {
+                // 单元已由接管者负责，不写完成标记也不释放对方的租约
+                all_ok = false;
+            } else if (ok && job.markDone(unit.id, unit_success, unit_errors, seconds)) {
+                // 失败行已进入死信文件，单元仍视为完成（包括没有可解析行或全部失败的单元）
+                completed++;
+            } else {
+                job.release(unit.id);
+                all_ok = false;
+            }
         }
         
-        return records;
+        size_t done = job.doneCount(manifest);
+        std::cout << "\n👷 工作进程完成 " << completed << " 个单元；作业进度 " << done << "/" << manifest.units.size() << std::endl;
+        if (done == manifest.units.size()) {
+            finalizeJob(job_dir);
+        }
+        return all_ok;
     }
-
-    // 多线程工作函数
-    void workerThread(std::queue<ImportTask>& task_queue, std::mutex& queue_mutex, 
-                     ThreadSafeStats& stats, int total_groups,
-                     std::chrono::high_resolution_clock::time_point start_time,
-                     ProgressBar& progress_bar) {
-        
-        while (true) {
-            ImportTask task(0, 0, {});
-            
-            // 获取任务
-            {
-                std::lock_guard<std::mutex> lock(queue_mutex);
-                if (task_queue.empty()) {
-                    break;
-                }
-                task = std::move(task_queue.front());
-                task_queue.pop();
+    
+    // 全部单元完成后：合并各单元的映射表，并把作业分区表发布为默认分区表
+    bool finalizeJob(const std::string& job_dir) {
+        ImportJobDirectory job(job_dir);
+        ImportJobDirectory::Manifest manifest;
+        std::string error;
+        if (!job.readManifest(manifest, error)) {
+            std::cerr << "❌ " << error << std::endl;
+            return false;
+        }
+        long success = 0, errors = 0;
+        std::map<int, long> source_healpix_map;
+        SourceIndexBuilder source_index;
+        for (const auto& unit : manifest.units) {
+            std::ifstream done(job.donePath(unit.id));
+            if (!done.is_open()) {
+                std::cout << "⏳ 单元 " << unit.id << " 尚未完成" << std::endl;
+                return false;
             }
-            
-            // 执行任务
-            processImportTask(task, stats);
-            
-            // 更新进度
-            stats.incrementGroup();
-            int processed = stats.getProcessedGroups();
-            
-            // 实时显示进度条（每10个任务更新一次，避免过于频繁）
-            if (processed % 10 == 0 || processed == total_groups) {
-                auto current_time = std::chrono::high_resolution_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(current_time - start_time);
-                double rate = stats.getSuccess() / (elapsed.count() > 0 ? elapsed.count() : 1);
-                
-                progress_bar.displayProgress(processed, total_groups, 
-                                           stats.getSuccess(), stats.getError(), 
-                                           rate, elapsed.count());
+            std::string line;
+            while (std::getline(done, line)) {
+                if (line.rfind("success=", 0) == 0) success += std::atol(line.c_str() + 8);
+                else if (line.rfind("errors=", 0) == 0) errors += std::atol(line.c_str() + 7);
+            }
+            std::ifstream sources(job.sourcesPath(unit.id));
+            std::getline(sources, line);
+            while (std::getline(sources, line)) {
+                size_t comma = line.find(',');
+                if (comma == std::string::npos) continue;
+                source_healpix_map.emplace(std::atoi(line.c_str()), std::atol(line.c_str() + comma + 1));
             }
+            mergeSourceIndex(source_index, job.sourceIndexPath(unit.id));
         }
+        saveSourceMap(source_healpix_map);
+        saveSourceIndex(source_index, source_index_path);
+        std::map<long, PartitionEntry> partition_map;
+        if (loadPartitionMap(job.partitionMapPath(), partition_map)) {
+            savePartitionMap(partition_map_path, partition_map);
+        }
+        std::cout << "🏁 作业完成: " << manifest.units.size() << " 个单元，成功 " << success << " 条，失败 "
+                 << errors << " 条" << std::endl;
+        for (const auto& unit : manifest.units) {
+            std::error_code ec;
+            if (std::filesystem::file_size(job.deadLetterPath(unit.id), ec) > 8 && !ec) {
+                std::cout << "📮 单元 " << unit.id << " 死信: --replay_dead_letter " << job.deadLetterPath(unit.id) << std::endl;
+            }
+        }
+        return true;
     }
-
-    // 处理单个导入任务
-    void processImportTask(const ImportTask& task, ThreadSafeStats& stats) {
-        TAOS* task_conn = conn_pool->getConnection();
-        
-        try {
-            // 创建子表
-            std::string table_name_full = table_name + "_" + std::to_string(task.healpix_id) + "_" + std::to_string(task.source_id);
-            std::string create_sql = "CREATE TABLE IF NOT EXISTS " + table_name_full + 
-                                   " USING " + table_name + " TAGS (" + std::to_string(task.healpix_id) + 
-                                   ", " + std::to_string(task.source_id) + ")";
-            
-            TAOS_RES* result = taos_query(task_conn, create_sql.c_str());
-            if (taos_errno(result) != 0) {
-                taos_free_result(result);
-                conn_pool->returnConnection(task_conn);
-                stats.addError(task.records.size());
-                return;
+    
+    // 流式模式中单个子表的待写缓冲
+    struct StreamBatch {
+        long healpix_id = 0;
+        int source_id = 0;
+        std::vector<AstronomicalRecord> records;
+        std::chrono::steady_clock::time_point first_arrival;
+    };
+    
+    // 流式写入线程：取出待写缓冲，组内按时间排序后用自动建表的 INSERT ... USING 写入
+    void streamWriter(std::deque<StreamBatch>& queue, std::mutex& queue_mutex, std::condition_variable& queue_cv,
+                      const bool& closed, ThreadSafeStats& stats,
+                      LatencyHistogram& flush_latency, LatencyHistogram& ingest_lag) {
+        while (true) {
+            StreamBatch batch;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [&] { return closed || !queue.empty(); });
+                if (queue.empty()) return;
+                batch = std::move(queue.front());
+                queue.pop_front();
             }
-            taos_free_result(result);
+            queue_cv.notify_all();  // 唤醒因背压等待的读取线程
             
-            // 批量插入数据
-            for (size_t i = 0; i < task.records.size(); i += batch_size) {
-                size_t end_idx = std::min(i + batch_size, task.records.size());
-                
+            std::stable_sort(batch.records.begin(), batch.records.end(),
+                             [](const AstronomicalRecord& a, const AstronomicalRecord& b) { return a.ts_ms < b.ts_ms; });
+            std::vector<const AstronomicalRecord*> pointers;
+            pointers.reserve(batch.records.size());
+            for (const auto& record : batch.records) pointers.push_back(&record);
+            ImportTask task(batch.healpix_id, batch.source_id, pointers.data(), pointers.size(), 0, 0);
+            
+            std::string target = subTableName(batch.healpix_id, batch.source_id) + " USING " + table_name +
+                                 " TAGS (" + std::to_string(batch.healpix_id) + ", " +
+                                 std::to_string(batch.source_id) + ")";
+            TAOS* task_conn = acquireConnection();
+            size_t step = static_cast<size_t>(std::max(1, batch_size));
+            for (size_t i = 0; i < task.count; i += step) {
+                size_t end_idx = std::min(i + step, task.count);
+                auto build_start = StageTimers::Clock::now();
                 std::ostringstream insert_sql;
-                insert_sql << "INSERT INTO " << table_name_full << " VALUES ";
-                
-                for (size_t j = i; j < end_idx; ++j) {
-                    if (j > i) insert_sql << ",";
-                    const auto& record = *task.records[j];
-                    insert_sql << "('" << record.timestamp << "'," 
-                              << std::fixed << std::setprecision(6) << record.ra << ","
-                              << std::fixed << std::setprecision(6) << record.dec << ","
-                              << std::fixed << std::setprecision(2) << record.mag << ","
-                              << std::fixed << std::setprecision(6) << record.jd_tcb << ")";
-                }
+                insert_sql << "INSERT INTO " << target << " VALUES ";
+                appendValues(insert_sql, task, i, end_idx);
+                std::string sql = insert_sql.str();
+                timers.add(Stage::BUILD_SQL, StageTimers::Clock::now() - build_start);
                 
-                result = taos_query(task_conn, insert_sql.str().c_str());
-                if (taos_errno(result) == 0) {
+                throttle(end_idx - i, sql.size());
+                int error_code = 0;
+                std::string error_message;
+                auto flush_start = std::chrono::steady_clock::now();
+                bool ok = executeWithRetry(task_conn, -1, sql, stats, error_code, error_message);
+                auto flush_end = std::chrono::steady_clock::now();
+                flush_latency.record(std::chrono::duration<double, std::micro>(flush_end - flush_start).count());
+                if (ok) {
                     stats.addSuccess(end_idx - i);
+                    ingest_lag.record(std::chrono::duration<double, std::micro>(flush_end - batch.first_arrival).count());
                 } else {
+                    dead_letter->write(task.healpix_id, task.source_id, error_code, error_message,
+                                       task.records + i, end_idx - i);
+                    stats.addDeadLetter(end_idx - i);
                     stats.addError(end_idx - i);
                 }
-                taos_free_result(result);
             }
+            conn_pool->returnConnection(task_conn);
+            stats.incrementGroup();
+        }
+    }
+    
+    // 流式导入：从标准输入或 FIFO 持续读取，按持久化分区表分配 healpix_id，
+    // 子表缓冲达到 flush_rows 行或最早一行等待超过 flush_ms 毫秒即交给写入线程
+    bool streamImport(const std::string& input) {
+        std::ifstream fifo;
+        std::istream* in = &std::cin;
+        if (input != "-") {
+            fifo.open(input);
+            if (!fifo.is_open()) {
+                std::cerr << "❌ 无法打开输入流: " << input << std::endl;
+                return false;
+            }
+            in = &fifo;
+        }
+        
+        // 分区决策来自分区表；流中新出现的基础区块一律不细分
+        std::map<long, PartitionEntry> partition_map;
+        loadPartitionMap(partition_map_path, partition_map);
+        std::unordered_set<long> refined_bases;
+        for (const auto& pair : partition_map) {
+            if (pair.second.refined) refined_bases.insert(pair.first);
+        }
+        std::map<int, long> source_healpix_map;
+        loadSourceMap(source_healpix_map);
+        SourceIndexBuilder source_index;
+        mergeSourceIndex(source_index, source_index_path);
+        
+        std::cout << "\n🌊 流式导入: " << (input == "-" ? std::string("标准输入") : input)
+                 << "，按 " << flush_rows << " 行或 " << flush_ms << " 毫秒刷新子表缓冲，写入线程 "
+                 << thread_count << " 个" << std::endl;
+        
+        ThreadSafeStats stats;
+        ProgressBar progress_bar(60);
+        LatencyHistogram flush_latency;
+        LatencyHistogram ingest_lag;
+        using SteadyClock = std::chrono::steady_clock;
+        auto start_time = SteadyClock::now();
+        
+        std::map<std::pair<long, int>, StreamBatch> buffers;
+        std::deque<std::pair<std::pair<long, int>, SteadyClock::time_point>> arrival_order;
+        std::mutex buffer_mutex;
+        std::deque<StreamBatch> queue;
+        std::mutex queue_mutex;
+        std::condition_variable queue_cv;
+        bool closed = false;
+        const size_t max_queued = static_cast<size_t>(thread_count) * 4;
+        std::atomic<long> received{0};
+        std::atomic<long> buffered{0};
+        
+        // 调用方持有 buffer_mutex；队列过长时等待写入线程消化（背压）
+        auto enqueue = [&](std::map<std::pair<long, int>, StreamBatch>::iterator it) {
+            buffered -= static_cast<long>(it->second.records.size());
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [&] { return queue.size() < max_queued; });
+            queue.push_back(std::move(it->second));
+            buffers.erase(it);
+            lock.unlock();
+            queue_cv.notify_all();
+        };
+        
+        std::vector<std::thread> writers;
+        for (int i = 0; i < thread_count; ++i) {
+            writers.emplace_back(&TDengineHealpixImporter::streamWriter, this, std::ref(queue), std::ref(queue_mutex),
+                                 std::ref(queue_cv), std::cref(closed), std::ref(stats),
+                                 std::ref(flush_latency), std::ref(ingest_lag));
+        }
+        
+        // 定时线程：按到达顺序检查最早的缓冲，超时即刷新；每 5 秒输出一次状态
+        std::atomic<bool> reading{true};
+        std::thread timer([&]() {
+            auto tick = std::chrono::milliseconds(std::max(10, std::min(flush_ms / 4, 200)));
+            auto last_status = SteadyClock::now();
+            while (reading) {
+                std::this_thread::sleep_for(tick);
+                auto now = SteadyClock::now();
+                {
+                    std::lock_guard<std::mutex> lock(buffer_mutex);
+                    while (!arrival_order.empty() &&
+                           now - arrival_order.front().second >= std::chrono::milliseconds(flush_ms)) {
+                        auto it = buffers.find(arrival_order.front().first);
+                        // 缓冲可能已因行数触发刷新并重新开始，到达时间不一致时跳过
+                        if (it != buffers.end() && it->second.first_arrival == arrival_order.front().second) {
+                            enqueue(it);
+                        }
+                        arrival_order.pop_front();
+                    }
+                }
+                if (now - last_status >= std::chrono::seconds(5)) {
+                    last_status = now;
+                    double elapsed_s = std::chrono::duration<double>(now - start_time).count();
+                    std::ostringstream status;
+                    status << std::fixed << std::setprecision(1)
+                           << "🌊 已接收 " << received << " 行，已写入 " << stats.getSuccess() << " 行 ("
+                           << stats.getSuccess() / std::max(1.0, elapsed_s) << " 行/秒)，缓冲 " << buffered
+                           << " 行；刷新 p99 " << flush_latency.percentileMs(0.99) << "ms，入库延迟 p99 "
+                           << ingest_lag.percentileMs(0.99) << "ms";
+                    progress_bar.displayMessage(status.str());
+                }
+            }
+        });
+        
+        std::string line;
+        long bad_lines = 0;
+        while (std::getline(*in, line)) {
+            AstronomicalRecord record;
+            try {
+                if (!parseCsvRecord(line, record)) {
+                    bad_lines++;
+                    continue;
+                }
+            } catch (...) {
+                bad_lines++;  // 表头或格式错误的行
+                continue;
+            }
+            long base_id = 0;
+            record.healpix_id = calculateAdaptiveHealpixId(record.ra, record.dec, record.source_id,
+                                                           refined_bases, &base_id);
+            auto& entry = partition_map[base_id];
+            entry.count++;
+            source_healpix_map.emplace(record.source_id, record.healpix_id);
+            source_index.add(record.source_id, record.healpix_id, record.ra, record.dec, record.ts_ms);
+            received++;
+            buffered++;
             
-        } catch (...) {
-            stats.addError(task.records.size());
+            std::lock_guard<std::mutex> lock(buffer_mutex);
+            auto key = std::make_pair(record.healpix_id, record.source_id);
+            auto it = buffers.find(key);
+            if (it == buffers.end()) {
+                it = buffers.emplace(key, StreamBatch()).first;
+                it->second.healpix_id = record.healpix_id;
+                it->second.source_id = record.source_id;
+                it->second.first_arrival = SteadyClock::now();
+                arrival_order.emplace_back(key, it->second.first_arrival);
+            }
+            it->second.records.push_back(std::move(record));
+            if (it->second.records.size() >= static_cast<size_t>(flush_rows)) {
+                enqueue(it);
+            }
         }
         
-        conn_pool->returnConnection(task_conn);
+        // 输入结束：刷新剩余缓冲并等待写入完成
+        reading = false;
+        timer.join();
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex);
+            while (!buffers.empty()) {
+                enqueue(buffers.begin());
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            closed = true;
+        }
+        queue_cv.notify_all();
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        
+        if (!dry_run) {
+            savePartitionMap(partition_map_path, partition_map);
+            saveSourceMap(source_healpix_map);
+            if (stats.getError() <= stats.getDeadLetterRows()) {
+                saveSourceIndex(source_index, source_index_path);
+            } else {
+                std::cerr << "⚠️ 有未进入死信的失败行，源位置索引未更新" << std::endl;
+            }
+        }
+        
+        double elapsed_s = std::chrono::duration<double>(SteadyClock::now() - start_time).count();
+        std::cout << "\n🌊 流式导入结束" << std::endl;
+        std::cout << "✅ 成功导入: " << stats.getSuccess() << " 条" << std::endl;
+        std::cout << "❌ 失败: " << stats.getError() << " 条" << std::endl;
+        if (bad_lines > 0) {
+            std::cout << "⚠️ 跳过无法解析的行: " << bad_lines << std::endl;
+        }
+        std::cout << "📦 刷新批次: " << stats.getProcessedGroups() << "，刷新耗时: " << flush_latency.summary() << std::endl;
+        std::cout << "⏳ 入库延迟 (接收到写入完成): " << ingest_lag.summary() << std::endl;
+        if (stats.getDeadLetterRows() > 0) {
+            std::cout << "📮 死信记录: " << stats.getDeadLetterRows() << " 条 -> " << dead_letter->path() << std::endl;
+        }
+        std::cout << "🚀 平均速度: " << static_cast<long>(stats.getSuccess() / std::max(1.0, elapsed_s)) << " 行/秒" << std::endl;
+        return stats.getError() == 0 || stats.getSuccess() > 0;
     }
     
-    bool importData(const std::vector<AstronomicalRecord>& records) {
+    // index 非空时把实际进入写入流程的记录（同时间戳去重后）计入源位置索引
+    bool importData(const std::vector<AstronomicalRecord>& records, SourceIndexBuilder* index = nullptr) {
         std::cout << "\n🚀 开始多线程导入数据到超级表..." << std::endl;
+        last_completed = false;
         std::cout << "🧵 线程数: " << thread_count << std::endl;
         
         auto start_time = std::chrono::high_resolution_clock::now();
+        auto group_start = StageTimers::Clock::now();
         
-        // 按 (healpix_id, source_id) 分组
-        std::map<std::pair<long, int>, std::vector<const AstronomicalRecord*>> groups;
-        
+        // 按 (healpix_id, source_id) 排序记录指针，同组记录连续存放，组内保持原始顺序
+        std::vector<const AstronomicalRecord*> ordered;
+        ordered.reserve(records.size());
         for (const auto& record : records) {
-            groups[{record.healpix_id, record.source_id}].push_back(&record);
+            ordered.push_back(&record);
+        }
+        std::stable_sort(ordered.begin(), ordered.end(),
+                         [](const AstronomicalRecord* a, const AstronomicalRecord* b) {
+                             if (a->healpix_id != b->healpix_id) return a->healpix_id < b->healpix_id;
+                             return a->source_id < b->source_id;
+                         });
+        orderGroups(ordered);
+        
+        timers.add(Stage::GROUP, StageTimers::Clock::now() - group_start);
+        
+        // 追加模式：一次性加载已有子表目录，只用于跳过建表；记录全部写入，
+        // 与已有记录同时间戳的行由 TDengine 覆盖写，重复追加同一批数据是幂等的
+        if (append) {
+            auto catalog_start = std::chrono::high_resolution_clock::now();
+            catalog = loadSubtableCatalog();
+            double catalog_seconds = std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - catalog_start).count();
+            std::cout << "📚 已有子表 " << catalog.size() << " 个 (加载 " << std::fixed << std::setprecision(2)
+                     << catalog_seconds << " 秒)" << std::endl;
+        }
+        
+        group_start = StageTimers::Clock::now();
+        
+        // 切分为任务区间；超大分组拆成若干子批，避免尾部长任务拖慢整体。子批序号为组内偏移 / 子批行数，
+        // 与检查点中的键一一对应
+        size_t split_rows = static_cast<size_t>(std::max(1, batch_size)) * SPLIT_BATCHES;
+        std::vector<ImportTask> tasks;
+        std::vector<std::pair<long, int>> table_keys;
+        std::vector<char> table_exists;
+        for (size_t begin = 0; begin < ordered.size();) {
+            long healpix_id = ordered[begin]->healpix_id;
+            int source_id = ordered[begin]->source_id;
+            size_t end = begin + 1;
+            while (end < ordered.size() &&
+                   ordered[end]->healpix_id == healpix_id &&
+                   ordered[end]->source_id == source_id) {
+                ++end;
+            }
+            bool exists = append && catalog.count(subTableName(healpix_id, source_id)) > 0;
+            for (size_t chunk = begin; chunk < end; chunk += split_rows) {
+                tasks.emplace_back(healpix_id, source_id,
+                                   ordered.data() + chunk, std::min(split_rows, end - chunk),
+                                   table_keys.size(), static_cast<uint32_t>((chunk - begin) / split_rows));
+                tasks.back().create_table = !exists;
+            }
+            table_keys.emplace_back(healpix_id, source_id);
+            table_exists.push_back(exists ? 1 : 0);
+            begin = end;
+        }
+        size_t group_count = table_keys.size();
+        if (index) {
+            for (size_t r = 0; r < ordered.size(); ++r) {
+                index->add(ordered[r]->source_id, ordered[r]->healpix_id, ordered[r]->ra, ordered[r]->dec,
+                           ordered[r]->ts_ms);
+            }
+        }
+        timers.add(Stage::GROUP, StageTimers::Clock::now() - group_start);
+        if (append) {
+            size_t existing_groups = std::count(table_exists.begin(), table_exists.end(), 1);
+            std::cout << "➕ 追加导入: 记录 " << ordered.size() << " 条；涉及子表 "
+                     << group_count << " 个，其中需新建 " << (group_count - existing_groups) << " 个" << std::endl;
+        }
+        
+        // 检查点：续传时跳过已完成的任务
+        std::string journal_error;
+        if (checkpoint_enabled) {
+            journal = std::make_unique<CheckpointJournal>(checkpoint_interval);
+            if (!journal->open(checkpoint_path, input_fingerprint, resume, journal_error)) {
+                std::cerr << "❌ " << journal_error << std::endl;
+                journal.reset();
+                if (resume) return false;
+            }
+        }
+        size_t skipped_rows = 0;
+        size_t skipped_tasks = 0;
+        if (resume && journal) {
+            auto remaining_end = std::remove_if(tasks.begin(), tasks.end(), [&](const ImportTask& task) {
+                if (!journal->isDone(task.healpix_id, task.source_id, task.chunk)) return false;
+                skipped_rows += task.count;
+                skipped_tasks++;
+                return true;
+            });
+            tasks.erase(remaining_end, tasks.end());
+            std::cout << "♻️ 断点续传: 跳过已完成任务 " << skipped_tasks << " 个 (" << skipped_rows
+                     << " 行)，剩余 " << tasks.size() << " 个" << std::endl;
         }
         
+        // LPT：大任务优先调度
+        std::stable_sort(tasks.begin(), tasks.end(), [](const ImportTask& a, const ImportTask& b) {
+            return a.count > b.count;
+        });
+        
         std::cout << "📊 导入统计预览:" << std::endl;
         std::cout << "   - 总记录数: " << records.size() << std::endl;
-        std::cout << "   - 子表数量: " << groups.size() << std::endl;
+        std::cout << "   - 子表数量: " << group_count << std::endl;
+        std::cout << "   - 任务数量: " << tasks.size() << " (单任务上限 " << split_rows << " 行)" << std::endl;
         std::cout << "   - 批处理大小: " << batch_size << std::endl;
         
-        // 创建任务队列和进度条
-        std::queue<ImportTask> task_queue;
-        std::mutex queue_mutex;
+        // 可选的预建表阶段：导入阶段不再执行 DDL
+        double precreate_seconds = 0.0;
+        if (precreate_tables) {
+            std::vector<char> has_task(group_count, 0);
+            for (const auto& task : tasks) {
+                has_task[task.group_index] = 1;
+            }
+            std::vector<size_t> needed;
+            for (size_t g = 0; g < group_count; ++g) {
+                if (has_task[g] && !table_exists[g]) needed.push_back(g);
+            }
+            std::cout << "\n🏗️ 预建子表: " << needed.size() << " 个，每条语句最多 " << create_batch << " 个" << std::endl;
+            auto precreate_start = std::chrono::high_resolution_clock::now();
+            std::vector<char> created = precreateSubTables(table_keys, needed);
+            precreate_seconds = std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - precreate_start).count();
+            for (auto& task : tasks) {
+                task.create_table = !created[task.group_index] && !table_exists[task.group_index];
+            }
+            std::cout << "⏱️ 预建表耗时: " << std::fixed << std::setprecision(2) << precreate_seconds << " 秒" << std::endl;
+        }
+        auto insert_start = std::chrono::high_resolution_clock::now();
+        
+        // 任务分片：路由模式下按子表所在 vgroup 分片，否则全部任务在同一分片
+        std::vector<std::unique_ptr<TaskShard>> shards;
+        if (vgroup_routing) {
+            auto layout = loadSubtableCatalog();
+            std::map<int, size_t> shard_of_vgroup;
+            for (size_t t = 0; t < tasks.size(); ++t) {
+                auto it = layout.find(subTableName(tasks[t].healpix_id, tasks[t].source_id));
+                int vgroup = (it != layout.end()) ? it->second : -1;
+                auto inserted = shard_of_vgroup.emplace(vgroup, shards.size());
+                if (inserted.second) {
+                    shards.push_back(std::make_unique<TaskShard>(vgroup));
+                }
+                shards[inserted.first->second]->task_indices.push_back(t);
+            }
+            std::vector<int> vgroups;
+            for (const auto& entry : shard_of_vgroup) {
+                if (entry.first >= 0) vgroups.push_back(entry.first);
+            }
+            conn_pool->assignAffinity(vgroups);
+            std::cout << "🧭 vgroup 路由: " << vgroups.size() << " 个 vgroup，已知布局子表 "
+                     << layout.size() << " 个" << std::endl;
+            for (const auto& shard : shards) {
+                size_t shard_rows = 0;
+                for (size_t t : shard->task_indices) shard_rows += tasks[t].count;
+                std::cout << "   - vgroup " << shard->vgroup << ": " << shard->task_indices.size()
+                         << " 个任务, " << shard_rows << " 行" << std::endl;
+            }
+        }
+        if (shards.empty()) {
+            shards.push_back(std::make_unique<TaskShard>(-1));
+            for (size_t t = 0; t < tasks.size(); ++t) {
+                shards.back()->task_indices.push_back(t);
+            }
+        }
+        
+        // 创建进度条
         ThreadSafeStats stats;
         ProgressBar progress_bar(60);  // 60字符宽的进度条
         
-        for (const auto& group : groups) {
-            task_queue.emplace(group.first.first, group.first.second, group.second);
+        controller = std::make_unique<AdaptiveIngestController>(adaptive, batch_size, thread_count, max_sql_bytes);
+        controller->setLogger([&progress_bar](const std::string& message) {
+            progress_bar.displayMessage(message);
+        });
+        if (adaptive) {
+            std::cout << "🎛️ 自适应模式: 初始批大小 " << batch_size << "，初始活跃线程 "
+                     << controller->activeWorkers() << "/" << thread_count
+                     << "，SQL 长度上限 " << max_sql_bytes << " 字节" << std::endl;
+        }
+        
+        if (rate_limit.active()) {
+            // 探测查询需要真实服务端
+            RateLimitConfig qos_config = rate_limit;
+            if (!backend->isServer()) qos_config.probe_sql.clear();
+            qos = std::make_unique<IngestQosGovernor>(
+                limiter, qos_config, host, user, password, db_name, port,
+                [&stats]() { return static_cast<long>(stats.getSuccess()); },
+                [&progress_bar](const std::string& message) { progress_bar.displayMessage(message); });
+            std::cout << "🚦 写入限速: 行速率 " << static_cast<long>(limiter.rowsRate()) << "/s，字节速率 "
+                     << static_cast<long>(limiter.bytesRate()) << "/s (0=不限)";
+            if (!rate_limit.control_file.empty()) {
+                std::cout << "，控制文件 " << rate_limit.control_file << " (kill -HUP " << getpid() << " 立即重读)";
+            }
+            if (qos->feedbackEnabled()) {
+                std::cout << "，探测延迟目标 " << rate_limit.probe_target_ms << "ms";
+            }
+            std::cout << std::endl;
         }
         
         std::cout << "\n📊 开始多线程导入..." << std::endl;
         
+        long total_task_rows = 0;
+        for (const auto& task : tasks) total_task_rows += static_cast<long>(task.count);
+        ProgressReporter reporter(stats, progress_bar, static_cast<int>(tasks.size()), total_task_rows,
+                                  progress_interval, progress_json_path);
+        
         // 启动工作线程
         std::vector<std::thread> workers;
         for (int i = 0; i < thread_count; ++i) {
-            workers.emplace_back(&TDengineHealpixImporter::workerThread, this,
-                               std::ref(task_queue), std::ref(queue_mutex),
-                               std::ref(stats), static_cast<int>(groups.size()), 
-                               start_time, std::ref(progress_bar));
+            workers.emplace_back(&TDengineHealpixImporter::workerThread, this, i,
+                               std::cref(tasks), std::ref(shards), std::ref(stats));
         }
         
-        // 等待所有线程完成
+        // 等待所有线程完成，输出最终进度
         for (auto& worker : workers) {
             worker.join();
         }
-        
-        // 确保进度条显示100%
-        auto final_time = std::chrono::high_resolution_clock::now();
-        auto final_elapsed = std::chrono::duration_cast<std::chrono::seconds>(final_time - start_time);
-        double final_rate = stats.getSuccess() / (final_elapsed.count() > 0 ? final_elapsed.count() : 1);
-        progress_bar.displayProgress(groups.size(), groups.size(), 
-                                   stats.getSuccess(), stats.getError(), 
-                                   final_rate, final_elapsed.count());
+        reporter.finish();
+        std::vector<std::string> qos_decisions;
+        std::string probe_summary;
+        if (qos) {
+            qos_decisions = qos->decisions();
+            if (qos->feedbackEnabled()) probe_summary = qos->probeLatency().summary();
+            qos.reset();
+        }
+        bool aborted = abort_import.load();
+        if (aborted) {
+            std::cerr << "⚠️ 导入被中止，剩余任务未写入" << std::endl;
+        }
+        if (journal) {
+            journal->close();
+            if (!aborted && stats.getError() <= stats.getDeadLetterRows()) {
+                // 全部任务已处理完且失败行都已进入死信文件：检查点不再有用，删除（失败行用 --replay_dead_letter 重放）
+                std::error_code ec;
+                std::filesystem::remove(journal->path(), ec);
+                std::cout << "💾 导入完成，已删除检查点: " << journal->path() << std::endl;
+            } else if (journal->failed()) {
+                std::cerr << "⚠️ 检查点写入中途失败，仅记录了 " << journal->writtenCount()
+                         << " 个完成任务，续传时其余任务会重新写入: " << journal->path() << std::endl;
+            } else {
+                std::cout << "💾 检查点已同步: " << journal->path() << " (本次新增 "
+                         << journal->writtenCount() << " 个完成任务)" << std::endl;
+            }
+        }
         
         auto end_time = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time);
+        double insert_seconds = std::chrono::duration<double>(end_time - insert_start).count();
         
         // 生成导入报告
         generateImportReport(records.size(), stats.getSuccess(), stats.getError(), 
-                           duration.count(), groups.size());
+                           duration.count(), group_count, precreate_seconds, insert_seconds,
+                           stats.getRetries(), stats.getDeadLetterRows(), qos_decisions, probe_summary);
         
         std::cout << "\n🎉 多线程导入完成！" << std::endl;
         std::cout << "✅ 成功导入: " << stats.getSuccess() << " 条" << std::endl;
         std::cout << "❌ 失败: " << stats.getError() << " 条" << std::endl;
         std::cout << "📊 成功率: " << std::fixed << std::setprecision(2) 
                  << (stats.getSuccess() * 100.0 / (stats.getSuccess() + stats.getError())) << "%" << std::endl;
+        std::cout << "🔌 取连接等待: " << conn_pool->waitHistogram().summary() << std::endl;
+        std::cout << "🔌 连接持有: " << conn_pool->holdHistogram().summary() << std::endl;
+        if (stats.getRetries() > 0) {
+            std::cout << "🔁 重试次数: " << stats.getRetries() << std::endl;
+        }
+        if (stats.getDeadLetterRows() > 0) {
+            std::cout << "📮 死信记录: " << stats.getDeadLetterRows() << " 条 (" << dead_letter->batches()
+                     << " 批) -> " << dead_letter->path() << std::endl;
+            std::cout << "   重放: --replay_dead_letter " << dead_letter->path() << std::endl;
+        }
+        if (limiter.throttledBatches() > 0) {
+            std::cout << "🚦 限速等待: " << limiter.throttledBatches() << " 批，"
+                     << limiter.throttleWait().summary() << std::endl;
+        }
+        if (skipped_tasks > 0) {
+            std::cout << "♻️ 续传跳过: " << skipped_rows << " 条 (" << skipped_tasks << " 个任务)" << std::endl;
+        }
         std::cout << "⏱️ 总耗时: " << duration.count() << " 秒" << std::endl;
+        if (precreate_tables) {
+            std::cout << "   - 预建表阶段: " << std::fixed << std::setprecision(2) << precreate_seconds << " 秒" << std::endl;
+            std::cout << "   - 写入阶段: " << insert_seconds << " 秒" << std::endl;
+        }
         std::cout << "🚀 平均速度: " << (stats.getSuccess() / std::max(1, static_cast<int>(duration.count()))) << " 行/秒" << std::endl;
-        std::cout << "📁 子表数量: " << groups.size() << std::endl;
+        std::cout << "📁 子表数量: " << group_count << std::endl;
         std::cout << "🧵 使用线程数: " << thread_count << std::endl;
+        if (!backend->isServer()) {
+            std::cout << "🧪 写入后端: " << backend->describe() << (dry_run ? " [试运行]" : "") << std::endl;
+        }
+        std::cout << "⏱️ 分阶段耗时 (各线程累计):";
+        for (int i = 0; i < StageTimers::STAGES; ++i) {
+            Stage stage = static_cast<Stage>(i);
+            std::cout << (i % 3 == 0 ? "\n   " : "  ") << StageTimers::label(stage) << " "
+                     << std::fixed << std::setprecision(2) << timers.seconds(stage) << "s";
+        }
+        std::cout << std::endl;
         
-        return stats.getSuccess() > 0;
+        last_success = stats.getSuccess();
+        last_errors = stats.getError();
+        // 只有未进入死信的失败行（写入异常）才使单元保持未完成，由其他进程重试
+        last_completed = !aborted && stats.getError() <= stats.getDeadLetterRows();
+        return stats.getSuccess() > 0 || (tasks.empty() && skipped_tasks > 0);
     }
     
 private:
     void generateImportReport(int total_records, int success_count, int error_count, 
-                            int duration_seconds, int table_count) {
+                            int duration_seconds, int table_count,
+                            double precreate_seconds, double insert_seconds,
+                            int retry_count, int dead_letter_rows,
+                            const std::vector<std::string>& qos_decisions,
+                            const std::string& probe_summary) {
         std::filesystem::create_directories("output/logs");
         
         auto now = std::chrono::system_clock::now();
@@ -632,6 +3659,7 @@ private:
             
             report << "导入时间: " << current_time_ss.str() << "\n";
             report << "目标数据库: " << db_name << "\n";
+            report << "写入后端: " << backend->describe() << "\n";
             report << "基础NSIDE: " << nside_base << "\n";
             report << "细分NSIDE: " << nside_fine << "\n";
             report << "细分阈值: " << count_threshold << "\n";
@@ -648,17 +3676,135 @@ private:
             if (duration_seconds > 0) {
                 report << "  - 导入速度: " << (success_count / duration_seconds) << " 行/秒\n";
             }
+            report << "  - 重试次数: " << retry_count << " (上限 " << retry_times << " 次/批)\n";
+            if (dead_letter_rows > 0) {
+                report << "  - 死信记录: " << dead_letter_rows << " -> " << dead_letter->path() << "\n";
+            }
+            
+            report << "\n🕒 组内时间排序:\n";
+            report << "  - 乱序记录: " << ordering.out_of_order_rows << " (" << std::fixed << std::setprecision(2)
+                   << (total_records > 0 ? ordering.out_of_order_rows * 100.0 / total_records : 0.0) << "%)\n";
+            report << "  - 重排子表: " << ordering.reordered_groups << "/" << ordering.groups << "\n";
+            report << "  - 合并重复时间戳: " << ordering.duplicate_rows << "\n";
+            report << "  - 排序耗时: " << ordering.seconds << " 秒\n";
             
             report << "\n🏗️ 表结构统计:\n";
             report << "  - 子表数量: " << table_count << "\n";
             
+            report << "\n⏱️ 阶段耗时:\n";
+            if (precreate_tables) {
+                report << "  - 预建表阶段: " << std::fixed << std::setprecision(2) << precreate_seconds << " 秒"
+                       << " (每条语句最多 " << create_batch << " 个子表)\n";
+            }
+            report << "  - 写入阶段: " << std::fixed << std::setprecision(2) << insert_seconds << " 秒\n";
+            report << "\n⏱️ 分阶段耗时 (各线程累计):\n";
+            double client_seconds = 0.0, server_seconds = 0.0, wait_seconds = 0.0;
+            for (int i = 0; i < StageTimers::STAGES; ++i) {
+                Stage stage = static_cast<Stage>(i);
+                double seconds = timers.seconds(stage);
+                if (stage == Stage::CREATE_TABLES || stage == Stage::COMMIT) server_seconds += seconds;
+                else if (stage == Stage::NETWORK_WAIT) wait_seconds += seconds;
+                else client_seconds += seconds;
+                report << "  - " << StageTimers::label(stage) << ": " << std::fixed << std::setprecision(3)
+                       << seconds << " 秒\n";
+            }
+            double stage_total = client_seconds + server_seconds + wait_seconds;
+            if (stage_total > 0.0) {
+                report << "  - 客户端计算 " << std::setprecision(1) << client_seconds * 100.0 / stage_total
+                       << "%，服务端往返 " << server_seconds * 100.0 / stage_total
+                       << "%，等待 " << wait_seconds * 100.0 / stage_total << "%\n";
+                report << "  - 判断: " << (client_seconds >= server_seconds + wait_seconds
+                                            ? "客户端 CPU 受限（解析/分区/拼语句）"
+                                            : (server_seconds >= wait_seconds ? "主要在等待 TDengine 处理写入"
+                                                                              : "主要在等待连接/限速/重试退避"))
+                       << "\n";
+            }
+            
+            report << "\n👷 各工作线程耗时 (拼接语句 / 等待 / 提交 / 建表，秒):\n";
+            for (int w = 0; w < timers.workerCount(); ++w) {
+                report << "  - 线程 " << w << ": " << std::fixed << std::setprecision(3)
+                       << timers.workerSeconds(w, Stage::BUILD_SQL) << " / "
+                       << timers.workerSeconds(w, Stage::NETWORK_WAIT) << " / "
+                       << timers.workerSeconds(w, Stage::COMMIT) << " / "
+                       << timers.workerSeconds(w, Stage::CREATE_TABLES) << "\n";
+            }
+            
             report << "\n🧵 并发统计:\n";
             report << "  - 使用线程数: " << thread_count << "\n";
-            report << "  - 连接池大小: " << conn_pool->size() << "\n";
+            report << "  - 连接池大小: " << conn_pool->size() << " (范围 " << conn_pool->minSize()
+                   << "-" << conn_pool->maxSize() << ")\n";
+            report << "  - 建立连接: " << conn_pool->createdCount() << "，建连失败: " << conn_pool->failedConnects()
+                   << "，丢弃失效连接: " << conn_pool->droppedCount() << "\n";
+            report << "  - 取连接等待: " << conn_pool->waitHistogram().summary() << "\n";
+            report << "  - 连接持有: " << conn_pool->holdHistogram().summary() << "\n";
+            
+            if (rate_limit.active()) {
+                report << "\n🚦 限速与QoS:\n";
+                report << "  - 最终行速率: " << static_cast<long>(limiter.rowsRate()) << "/s，字节速率: "
+                       << static_cast<long>(limiter.bytesRate()) << "/s (0=不限)\n";
+                report << "  - 限速等待: " << limiter.throttledBatches() << " 批，"
+                       << limiter.throttleWait().summary() << "\n";
+                if (!probe_summary.empty()) {
+                    report << "  - 探测查询: " << rate_limit.probe_sql << "\n";
+                    report << "  - 探测延迟 (目标 " << rate_limit.probe_target_ms << "ms): " << probe_summary << "\n";
+                }
+                for (const auto& decision : qos_decisions) {
+                    report << "  * " << decision << "\n";
+                }
+            }
+            
+            if (controller && controller->enabled()) {
+                report << "\n🎛️ 自适应控制:\n";
+                report << "  - 最终批大小: " << controller->batchSize() << "\n";
+                report << "  - 最终活跃线程: " << controller->activeWorkers() << "\n";
+                report << "  - SQL 长度上限: " << max_sql_bytes << " 字节\n";
+                for (const auto& decision : controller->decisions()) {
+                    report << "  * " << decision << "\n";
+                }
+            }
             
             report.close();
             std::cout << "📄 导入报告已保存到: " << report_file << std::endl;
         }
+        
+        // JSON 旁路文件，便于脚本对比多次导入的阶段耗时
+        std::string json_file = "output/logs/import_report_" + timestamp_ss.str() + ".json";
+        std::ofstream json(json_file);
+        if (json.is_open()) {
+            auto stages_json = [this](int slot) {
+                std::ostringstream oss;
+                oss << "{";
+                for (int i = 0; i < StageTimers::STAGES; ++i) {
+                    Stage stage = static_cast<Stage>(i);
+                    double seconds = slot < 0 ? timers.seconds(stage) : timers.workerSeconds(slot, stage);
+                    oss << (i > 0 ? ", " : "") << "\"" << StageTimers::name(stage) << "\": "
+                        << std::fixed << std::setprecision(6) << seconds;
+                }
+                oss << "}";
+                return oss.str();
+            };
+            json << "{\n";
+            json << "  \"database\": \"" << db_name << "\",\n";
+            json << "  \"backend\": \"" << backend->name() << "\",\n";
+            json << "  \"dry_run\": " << (dry_run ? "true" : "false") << ",\n";
+            json << "  \"threads\": " << thread_count << ",\n";
+            json << "  \"total_records\": " << total_records << ",\n";
+            json << "  \"success\": " << success_count << ",\n";
+            json << "  \"errors\": " << error_count << ",\n";
+            json << "  \"duration_seconds\": " << duration_seconds << ",\n";
+            json << "  \"precreate_seconds\": " << std::fixed << std::setprecision(6) << precreate_seconds << ",\n";
+            json << "  \"insert_seconds\": " << insert_seconds << ",\n";
+            json << "  \"stages\": " << stages_json(-1) << ",\n";
+            json << "  \"workers\": [\n";
+            for (int w = 0; w < timers.workerCount(); ++w) {
+                json << "    {\"id\": " << w << ", \"stages\": " << stages_json(w) << "}"
+                     << (w + 1 < timers.workerCount() ? "," : "") << "\n";
+            }
+            json << "  ]\n";
+            json << "}\n";
+            json.close();
+            std::cout << "📄 阶段耗时 JSON: " << json_file << std::endl;
+        }
     }
 };
 
@@ -677,10 +3823,47 @@ void printUsage(const char* program_name) {
     std::cout << "  --password <密码>         密码 (默认: taosdata)\n";
     std::cout << "  --port <端口>             端口 (默认: 6030)\n";
     std::cout << "  --drop_db                 导入前删除数据库\n";
+    std::cout << "  --adaptive                自适应调整批大小和活跃线程数 (AIMD)\n";
+    std::cout << "  --max_sql_bytes <值>      单条SQL长度上限，约束批大小 (默认: 1048576)\n";
+    std::cout << "  --precreate_tables        导入前并发批量预建全部子表，写入阶段不执行DDL\n";
+    std::cout << "  --create_batch <值>       预建表时每条语句包含的子表数 (默认: 1000)\n";
+    std::cout << "  --checkpoint <文件>       检查点日志路径 (默认: output/checkpoints/<数据库名>.ckpt)\n";
+    std::cout << "  --checkpoint_interval <秒> 检查点 fsync 间隔 (默认: 5)\n";
+    std::cout << "  --resume                  读取检查点，跳过已完成的任务继续导入\n";
+    std::cout << "  --retry_times <值>        可重试错误（超时、vnode繁忙等）的最大重试次数 (默认: 3)\n";
+    std::cout << "  --dead_letter <文件>      永久失败批次的死信文件 (默认: output/dead_letter/<数据库名>_<时间>.dlq)\n";
+    std::cout << "  --replay_dead_letter <文件> 重放死信文件中的记录（无需 --input）\n";
+    std::cout << "  --pool_min <值>           连接池最小连接数 (默认: 线程数)\n";
+    std::cout << "  --pool_max <值>           连接池最大连接数 (默认: 2×线程数)\n";
+    std::cout << "  --vgroup_routing          按子表所在 vgroup 分片调度并合并同 vnode 的小批写入（隐含 --precreate_tables）\n";
+    std::cout << "  --progress_json <文件>    以 JSON Lines 追加进度采样 (rows, rows/s, in-flight, ETA)\n";
+    std::cout << "  --progress_interval <秒>  进度采样间隔 (默认: 1)\n";
+    std::cout << "  --dry-run                 试运行：完整执行读取、分区、分组和拼接语句，但不调用服务端，不写检查点和映射表\n";
+    std::cout << "  --backend <名称>          写入后端: taos | null | sim (默认: taos)\n";
+    std::cout << "  --sim_latency_ms <值>     sim 后端每条语句的延迟毫秒数 (默认: 5)\n";
+    std::cout << "  --sim_rows_per_sec <值>   sim 后端的写入吞吐上限 (默认: 0 不限)\n";
+    std::cout << "  --sim_error_rate <值>     sim 后端注入可重试错误的概率 (默认: 0)\n";
+    std::cout << "  --sim_fatal_rate <值>     sim 后端注入永久错误的概率 (默认: 0)\n";
+    std::cout << "  --flush_rows <值>         流式模式 (--input - 或 FIFO) 下子表缓冲的刷新行数 (默认: 批处理大小)\n";
+    std::cout << "  --flush_ms <值>           流式模式下缓冲最长等待毫秒数 (默认: 1000)\n";
+    std::cout << "  --append                  增量追加：批量加载已有子表目录，沿用分区表的细分决策，只建缺失子表；同时间戳的记录覆盖写\n";
+    std::cout << "  --partition_map <文件>    分区表路径 (默认: output/query_results/healpix_partition_map.csv)\n";
+    std::cout << "  --rate_rows <值>          写入行速率上限，行/秒 (默认: 0 不限)\n";
+    std::cout << "  --rate_bytes <值>         写入SQL字节速率上限，字节/秒 (默认: 0 不限)\n";
+    std::cout << "  --rate_control <文件>     运行时速率控制文件 (rows_per_sec=/bytes_per_sec=)，每秒轮询，SIGHUP 立即重读\n";
+    std::cout << "  --qos_probe_sql <SQL>     反馈限速的探测查询，例如一次锥形检索\n";
+    std::cout << "  --qos_target_ms <值>      探测查询延迟目标，超过即收紧写入速率\n";
+    std::cout << "  --coordinate <目录>       协调者：统计分区、切分工作单元并写出共享作业目录\n";
+    std::cout << "  --units <值>              工作单元数 (默认: 4×--spawn，否则 16)\n";
+    std::cout << "  --spawn <值>              协调完成后在本机启动 N 个工作进程并等待作业完成\n";
+    std::cout << "  --worker <目录>           工作进程：从作业目录抢占单元租约并导入（无需 --input）\n";
+    std::cout << "  --lease_ttl <秒>          单元租约过期时间，超时未刷新的单元可被其他进程接管 (默认: 60)\n";
     std::cout << "  --help                    显示此帮助信息\n\n";
     std::cout << "示例:\n";
     std::cout << "  " << program_name << " --input data.csv --db sensor_db_healpix --threads 16\n";
     std::cout << "  " << program_name << " --input data.csv --db test_db --nside_base 128 --drop_db --threads 4\n";
+    std::cout << "  " << program_name << " --input data.csv --db sensor_db_healpix --coordinate /shared/job --spawn 4\n";
+    std::cout << "  " << program_name << " --db sensor_db_healpix --worker /shared/job --threads 16\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -696,6 +3879,34 @@ int main(int argc, char* argv[]) {
     int batch_size = 500;
     int thread_count = 8;
     bool drop_db = false;
+    bool adaptive = false;
+    size_t max_sql_bytes = 1048576;
+    bool precreate_tables = false;
+    int create_batch = 1000;
+    std::string checkpoint_path;
+    double checkpoint_interval = 5.0;
+    bool resume = false;
+    int retry_times = 3;
+    std::string dead_letter_path;
+    std::string replay_path;
+    int pool_min = 0;
+    int pool_max = 0;
+    bool vgroup_routing = false;
+    RateLimitConfig rate_limit;
+    bool append = false;
+    std::string partition_map_path;
+    int flush_rows = 0;
+    int flush_ms = 1000;
+    std::string backend_name = "taos";
+    bool dry_run = false;
+    std::string progress_json_path;
+    double progress_interval = 1.0;
+    SimulatedBackendConfig sim_config;
+    std::string coordinate_dir;
+    std::string worker_dir;
+    int unit_count = 0;
+    int spawn_count = 0;
+    int lease_ttl = 60;
     
     // 解析命令行参数
     for (int i = 1; i < argc; ++i) {
@@ -723,6 +3934,76 @@ int main(int argc, char* argv[]) {
             thread_count = std::atoi(argv[++i]);
         } else if (std::strcmp(argv[i], "--drop_db") == 0) {
             drop_db = true;
+        } else if (std::strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = true;
+        } else if (std::strcmp(argv[i], "--max_sql_bytes") == 0 && i + 1 < argc) {
+            max_sql_bytes = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--precreate_tables") == 0) {
+            precreate_tables = true;
+        } else if (std::strcmp(argv[i], "--create_batch") == 0 && i + 1 < argc) {
+            create_batch = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--checkpoint_interval") == 0 && i + 1 < argc) {
+            checkpoint_interval = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--resume") == 0) {
+            resume = true;
+        } else if (std::strcmp(argv[i], "--retry_times") == 0 && i + 1 < argc) {
+            retry_times = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--dead_letter") == 0 && i + 1 < argc) {
+            dead_letter_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay_dead_letter") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--pool_min") == 0 && i + 1 < argc) {
+            pool_min = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--pool_max") == 0 && i + 1 < argc) {
+            pool_max = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--vgroup_routing") == 0) {
+            vgroup_routing = true;
+        } else if (std::strcmp(argv[i], "--progress_json") == 0 && i + 1 < argc) {
+            progress_json_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--progress_interval") == 0 && i + 1 < argc) {
+            progress_interval = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--dry-run") == 0 || std::strcmp(argv[i], "--dry_run") == 0) {
+            dry_run = true;
+        } else if (std::strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            backend_name = argv[++i];
+        } else if (std::strcmp(argv[i], "--sim_latency_ms") == 0 && i + 1 < argc) {
+            sim_config.latency_ms = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sim_rows_per_sec") == 0 && i + 1 < argc) {
+            sim_config.rows_per_sec = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sim_error_rate") == 0 && i + 1 < argc) {
+            sim_config.error_rate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sim_fatal_rate") == 0 && i + 1 < argc) {
+            sim_config.fatal_rate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--flush_rows") == 0 && i + 1 < argc) {
+            flush_rows = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--flush_ms") == 0 && i + 1 < argc) {
+            flush_ms = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--append") == 0) {
+            append = true;
+        } else if (std::strcmp(argv[i], "--partition_map") == 0 && i + 1 < argc) {
+            partition_map_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--rate_rows") == 0 && i + 1 < argc) {
+            rate_limit.rows_per_sec = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rate_bytes") == 0 && i + 1 < argc) {
+            rate_limit.bytes_per_sec = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rate_control") == 0 && i + 1 < argc) {
+            rate_limit.control_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--qos_probe_sql") == 0 && i + 1 < argc) {
+            rate_limit.probe_sql = argv[++i];
+        } else if (std::strcmp(argv[i], "--qos_target_ms") == 0 && i + 1 < argc) {
+            rate_limit.probe_target_ms = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--coordinate") == 0 && i + 1 < argc) {
+            coordinate_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--worker") == 0 && i + 1 < argc) {
+            worker_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--units") == 0 && i + 1 < argc) {
+            unit_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--spawn") == 0 && i + 1 < argc) {
+            spawn_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--lease_ttl") == 0 && i + 1 < argc) {
+            lease_ttl = std::atoi(argv[++i]);
         } else if (std::strcmp(argv[i], "--help") == 0) {
             printUsage(argv[0]);
             return 0;
@@ -733,18 +4014,64 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    // 检查必需参数
+    // 检查必需参数（重放死信时以死信文件作为输入）
+    if (!replay_path.empty()) {
+        input_file = replay_path;
+    }
+    if (!coordinate_dir.empty() && !worker_dir.empty()) {
+        std::cerr << "❌ --coordinate 与 --worker 不能同时使用" << std::endl;
+        return 1;
+    }
+    if (!worker_dir.empty()) {
+        // 工作进程的输入来自作业目录
+        if (!input_file.empty() || resume || append || drop_db) {
+            std::cerr << "❌ --worker 模式不接受 --input/--resume/--append/--drop_db，这些由作业目录决定" << std::endl;
+            return 1;
+        }
+        input_file = worker_dir + "/job.txt";
+    }
+    if (!coordinate_dir.empty() && (!replay_path.empty() || input_file == "-" || resume)) {
+        std::cerr << "❌ --coordinate 需要普通输入文件，且不支持 --resume 与 --replay_dead_letter" << std::endl;
+        return 1;
+    }
+    if (unit_count <= 0) {
+        unit_count = spawn_count > 0 ? 4 * spawn_count : 16;
+    }
     if (input_file.empty() || db_name.empty()) {
         std::cerr << "❌ 缺少必需参数 --input 和 --db" << std::endl;
         printUsage(argv[0]);
         return 1;
     }
     
-    // 检查输入文件
-    if (!std::filesystem::exists(input_file)) {
+    // 检查输入文件（"-" 为标准输入，命名管道按流式处理）
+    bool streaming = (input_file == "-");
+    if (!streaming && !std::filesystem::exists(input_file)) {
         std::cerr << "❌ 输入文件不存在: " << input_file << std::endl;
         return 1;
     }
+    if (!streaming && replay_path.empty() && coordinate_dir.empty() && worker_dir.empty() &&
+        std::filesystem::is_fifo(input_file)) {
+        streaming = true;
+    }
+    if (streaming && (resume || flush_ms < 1)) {
+        std::cerr << "❌ 流式模式不支持 --resume，且 --flush_ms 必须为正数" << std::endl;
+        return 1;
+    }
+    
+    if (resume && drop_db) {
+        std::cerr << "❌ --resume 不能与 --drop_db 同时使用" << std::endl;
+        return 1;
+    }
+    if (append && drop_db) {
+        std::cerr << "❌ --append 不能与 --drop_db 同时使用" << std::endl;
+        return 1;
+    }
+    
+    std::unique_ptr<WriteBackend> backend = makeWriteBackend(backend_name, sim_config);
+    if (!backend) {
+        std::cerr << "❌ 未知写入后端: " << backend_name << " (可选 taos | null | sim)" << std::endl;
+        return 1;
+    }
     
     // 验证线程数
     if (thread_count < 1 || thread_count > 64) {
@@ -756,19 +4083,29 @@ int main(int argc, char* argv[]) {
         std::cout << "🌟 TDengine Healpix 空间分析多线程数据导入器 (C++ 版本)" << std::endl;
         std::cout << "============================================================" << std::endl;
         
-        double file_size_mb = std::filesystem::file_size(input_file) / (1024.0 * 1024.0);
-        std::cout << "📁 输入文件: " << input_file << " (" << std::fixed 
-                 << std::setprecision(1) << file_size_mb << " MB)" << std::endl;
+        if (streaming) {
+            std::cout << "📁 输入流: " << (input_file == "-" ? std::string("标准输入") : input_file) << std::endl;
+        } else {
+            double file_size_mb = std::filesystem::file_size(input_file) / (1024.0 * 1024.0);
+            std::cout << "📁 输入文件: " << input_file << " (" << std::fixed 
+                     << std::setprecision(1) << file_size_mb << " MB)" << std::endl;
+        }
         std::cout << "🎯 目标数据库: " << db_name << std::endl;
         std::cout << "🏠 TDengine主机: " << host << ":" << port << std::endl;
-        std::cout << "🧵 线程数: " << thread_count << std::endl;
+        std::cout << "🧵 线程数: " << thread_count << (adaptive ? " (自适应上限)" : "") << std::endl;
         
         TDengineHealpixImporter importer(db_name, host, user, password, port,
                                         nside_base, nside_fine, count_threshold, 
-                                        batch_size, thread_count);
+                                        batch_size, thread_count, adaptive, max_sql_bytes,
+                                        precreate_tables, create_batch,
+                                        checkpoint_path, resume, checkpoint_interval,
+                                        retry_times, dead_letter_path, pool_min, pool_max,
+                                        vgroup_routing, rate_limit, append, partition_map_path,
+                                        flush_rows, flush_ms, std::move(backend), dry_run,
+                                        progress_json_path, progress_interval);
         
         // 删除数据库（如果指定）
-        if (drop_db) {
+        if (drop_db && !dry_run) {
             if (!importer.dropDatabase()) {
                 std::cerr << "❌ 删除数据库失败，停止执行" << std::endl;
                 return 1;
@@ -781,11 +4118,69 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
-        // 加载和处理数据
-        auto records = importer.loadAndProcessData(input_file);
-        
-        // 多线程导入数据
-        bool success = importer.importData(records);
+        bool success = false;
+        if (!coordinate_dir.empty()) {
+            // 协调者只负责建库建表和切分作业，写入由工作进程完成
+            success = importer.coordinate(input_file, coordinate_dir, unit_count);
+            if (success && spawn_count > 0) {
+                // 透传连接与导入参数，去掉仅协调者使用的参数
+                std::vector<std::string> child_args{argv[0]};
+                for (int i = 1; i < argc; ++i) {
+                    std::string arg = argv[i];
+                    if (arg == "--coordinate" || arg == "--units" || arg == "--spawn" || arg == "--input" ||
+                        arg == "--dead_letter") {
+                        ++i;
+                    } else if (arg != "--drop_db" && arg != "--append") {
+                        child_args.push_back(arg);
+                    }
+                }
+                child_args.push_back("--worker");
+                child_args.push_back(coordinate_dir);
+                std::vector<char*> child_argv;
+                for (auto& arg : child_args) child_argv.push_back(arg.data());
+                child_argv.push_back(nullptr);
+                
+                std::cout << "🚀 启动 " << spawn_count << " 个工作进程..." << std::endl;
+                std::cout.flush();
+                std::vector<pid_t> children;
+                for (int k = 0; k < spawn_count; ++k) {
+                    pid_t pid = fork();
+                    if (pid == 0) {
+                        execv("/proc/self/exe", child_argv.data());
+                        std::perror("execv");
+                        _exit(127);
+                    }
+                    if (pid > 0) children.push_back(pid);
+                }
+                int failed = 0;
+                for (pid_t pid : children) {
+                    int status = 0;
+                    waitpid(pid, &status, 0);
+                    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+                }
+                if (failed > 0) {
+                    std::cout << "⚠️ " << failed << " 个工作进程异常退出，未完成的单元可由 --worker 重新领取" << std::endl;
+                }
+                // 最后退出的工作进程通常已完成汇总，这里再确认一次
+                success = importer.finalizeJob(coordinate_dir);
+            }
+        } else if (!worker_dir.empty()) {
+            success = importer.runWorker(worker_dir, lease_ttl);
+        } else if (!replay_path.empty()) {
+            // 重放死信文件
+            success = importer.replayDeadLetter(replay_path);
+        } else if (streaming) {
+            // 流式导入
+            success = importer.streamImport(input_file);
+        } else {
+            // 加载和处理数据
+            auto records = importer.loadAndProcessData(input_file);
+            
+            // 多线程导入数据，完成后发布源位置索引
+            SourceIndexBuilder source_index;
+            success = importer.importData(records, &source_index);
+            importer.publishSourceIndex(source_index);
+        }
         
         if (success) {
             std::cout << "\n🎊 多线程数据导入成功完成！" << std::endl;